@@ -0,0 +1,44 @@
+// Uncertainty aggregation of plot, without drawing
+// Usage: bin/bench_aggregate [vars] [bins] [sources] [repetitions]
+
+#include <iostream>
+#include <string>
+#include <cstdio>
+
+#include "bench.hh"
+#include "synth.hh"
+#include "hepdata.hh"
+#include "uncert.hh"
+
+using namespace bench;
+
+int main(int argc, char* argv[]) {
+  const unsigned nvars = arg(argc,argv,1,200),
+                 nbins = arg(argc,argv,2,20),
+                 nsrc  = arg(argc,argv,3,60),
+                 reps  = arg(argc,argv,4,5);
+
+  const std::string file = write_temp(synth_hepdata(nvars,nbins,nsrc));
+  const auto data = hepdata::read(file.c_str());
+  std::remove(file.c_str());
+
+  const std::string size = "vars=" + std::to_string(nvars)
+    + ",bins=" + std::to_string(nbins) + ",sources=" + std::to_string(nsrc);
+
+  // groups are compiled once per input, as in plot
+  hepdata::groups_t groups = hepdata::default_groups();
+  groups.compile(data.sources);
+
+  double sink = 0;
+  for (bool corr : { false, true }) {
+    report("aggregate", size+(corr ? ",corr" : ""),
+      double(nvars)*nbins, "bins", time_it(reps,[&]{
+        for (const auto& var : data.vars)
+          sink += (corr
+            ? hepdata::make_bands(data,var.first,var.second,true)
+            : hepdata::make_bands(data,var.first,var.second,groups)
+          ).tuncs.back().back();
+      }));
+  }
+  if (sink==0) std::cerr << "no data" << std::endl;
+}
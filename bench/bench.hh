@@ -0,0 +1,48 @@
+#ifndef BENCH_HH
+#define BENCH_HH
+
+// Timing and reporting shared by benchmarks
+// Results are printed one JSON object per line, e.g.
+// {"bench":"parse","case":"threads=2","n":12000,"unit":"bins",
+//  "seconds":0.0123,"rate":975609}
+// where seconds is the best time out of all repetitions
+
+#include <string>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+namespace bench {
+
+template <typename F>
+double time_it(unsigned reps, F&& f) {
+  using clock = std::chrono::steady_clock;
+  double best = 0;
+  for (unsigned r=0; r<reps; ++r) {
+    const auto t0 = clock::now();
+    f();
+    const double t = std::chrono::duration<double>(clock::now()-t0).count();
+    if (r==0 || t < best) best = t;
+  }
+  return best;
+}
+
+inline void report(
+  const char* bench, const std::string& case_name,
+  double n, const char* unit, double seconds
+) {
+  std::printf(
+    "{\"bench\":\"%s\",\"case\":\"%s\",\"n\":%.17g,\"unit\":\"%s\","
+    "\"seconds\":%.6g,\"rate\":%.6g}\n",
+    bench, case_name.c_str(), n, unit, seconds, n/seconds);
+  std::fflush(stdout);
+}
+
+// positional argument or default value
+inline unsigned arg(int argc, char* argv[], int i, unsigned def) {
+  return argc>i ? std::strtoul(argv[i],nullptr,10) : def;
+}
+
+}
+
+#endif
@@ -0,0 +1,86 @@
+// Covariance of bins of all variables, from shift vectors of sources
+// Times a plain triple loop over bins and sources, and the blocked engine
+// on 1 and all hardware threads
+// Usage: bin/bench_cov [vars] [bins] [sources] [repetitions]
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <cstdio>
+
+#include "bench.hh"
+#include "synth.hh"
+#include "hepdata.hh"
+#include "covariance.hh"
+
+using namespace bench;
+
+int main(int argc, char* argv[]) {
+  const unsigned nvars = arg(argc,argv,1,20),
+                 nbins = arg(argc,argv,2,20),
+                 nsrc  = arg(argc,argv,3,200),
+                 reps  = arg(argc,argv,4,3);
+
+  const std::string file = write_temp(synth_hepdata(nvars,nbins,nsrc));
+  const auto data = hepdata::read(file.c_str());
+  std::remove(file.c_str());
+
+  const std::string size = "vars=" + std::to_string(nvars)
+    + ",bins=" + std::to_string(nbins) + ",sources=" + std::to_string(nsrc);
+  const std::vector<std::string> uncorr { "bkg_model_uncorr" };
+  const int uncorr_id = data.sources.find(uncorr[0]);
+
+  // rows of relative shifts, in the same order as in the engine
+  std::vector<std::vector<double>> rows;
+  std::vector<int> row_of(data.sources.size(),-1);
+  std::vector<double> diag;
+  size_t n = 0;
+  for (const auto& v : data.vars) n += v.second.nbins();
+  size_t o = 0;
+  for (const auto& v : data.vars) {
+    const auto& var = v.second;
+    for (const auto& b : var.bins) {
+      const double x = b.stat/b.xsec;
+      diag.push_back(x*x);
+    }
+    for (unsigned c=0; c<var.ncols(); ++c) {
+      const int id = var.src[c];
+      if (id!=uncorr_id && row_of[id] < 0) {
+        row_of[id] = rows.size();
+        rows.emplace_back(n);
+      }
+      for (unsigned i=0; i<var.nbins(); ++i) {
+        if (!var.col_has(c)[i]) continue;
+        const double x = var.col_shift(c)[i]/var.bins[i].xsec;
+        if (id==uncorr_id) diag[o+i] += x*x;
+        else rows[row_of[id]][o+i] = x;
+      }
+    }
+    o += var.nbins();
+  }
+
+  std::vector<double> naive(n*n);
+  const double t_naive = time_it(reps,[&]{
+    for (size_t i=0; i<n; ++i)
+      for (size_t j=0; j<n; ++j) {
+        double c = 0;
+        for (const auto& row : rows) c += row[i]*row[j];
+        naive[i*n+j] = c + (i==j ? diag[i] : 0.);
+      }
+  });
+  const double npairs = double(n)*n;
+  report("cov.naive", size, npairs, "pairs", t_naive);
+
+  const unsigned nall = std::thread::hardware_concurrency();
+  for (unsigned nthreads : { 1u, nall }) {
+    hepdata::covariance_t cov;
+    report("cov.blocked", size+",threads="+std::to_string(nthreads),
+      npairs, "pairs", time_it(reps,[&]{
+        cov = hepdata::covariance(data,{},uncorr,nthreads);
+      }));
+    if (cov.cov != naive)
+      std::cerr << "\033[31m" << size << ": results differ\033[0m" << std::endl;
+    if (nall==1) break;
+  }
+}
@@ -0,0 +1,102 @@
+// Throughput of number conversion methods used for parsing inputs
+// Usage: bin/bench_from_chars [number of values] [repetitions]
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <cstdio>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include "bench.hh"
+#include "from_chars.hh"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+
+// HepData-like line of numbers separated by ':'
+std::string make_input(unsigned n, std::vector<size_t>& pos) {
+  std::mt19937 gen(42);
+  std::uniform_real_distribution<double> mant(-10.,10.);
+  std::uniform_int_distribution<int> expo(-6,4), prec(1,8), fmt(0,3);
+  std::string s;
+  pos.reserve(n+1);
+  char buf[64];
+  for (unsigned i=0; i<n; ++i) {
+    const double x = mant(gen) * std::pow(10.,expo(gen));
+    const int p = prec(gen);
+    switch (fmt(gen)) {
+      case 0: std::snprintf(buf,sizeof(buf),"%.*g",p,x); break;
+      case 1: std::snprintf(buf,sizeof(buf),"%.*f",p,x); break;
+      case 2: std::snprintf(buf,sizeof(buf),"%.*e",p,x); break;
+      default: std::snprintf(buf,sizeof(buf),"%+.*g",p+9,x); break;
+    }
+    pos.push_back(s.size());
+    s += buf;
+    s += ':';
+  }
+  pos.push_back(s.size());
+  return s;
+}
+
+int main(int argc, char* argv[]) {
+  const unsigned n = bench::arg(argc,argv,1,1000000);
+  const unsigned reps = bench::arg(argc,argv,2,5);
+
+  std::vector<size_t> pos;
+  const std::string line = make_input(n,pos);
+  std::vector<double> ref(n), out(n);
+
+  for (unsigned i=0; i<n; ++i)
+    ref[i] = std::strtod(line.c_str()+pos[i],nullptr);
+
+  const auto check = [&](const char* name){
+    unsigned bad = 0;
+    for (unsigned i=0; i<n; ++i)
+      if (std::memcmp(&out[i],&ref[i],sizeof(double))) ++bad;
+    if (bad) cerr << name << ": " << bad << " values differ from strtod\n";
+    return bad;
+  };
+
+  const auto report = [&](const char* name, double t){
+    bench::report("from_chars",name,n,"values",t);
+  };
+
+  unsigned bad = 0;
+
+  report("std::stod(substr)", bench::time_it(reps,[&]{
+    for (unsigned i=0; i<n; ++i)
+      out[i] = std::stod(line.substr(pos[i],pos[i+1]-pos[i]-1));
+  }));
+  bad += check("std::stod");
+
+  report("std::stringstream", bench::time_it(reps,[&]{
+    std::stringstream ss;
+    for (unsigned i=0; i<n; ++i) {
+      ss.clear();
+      ss.str(line.substr(pos[i],pos[i+1]-pos[i]-1));
+      ss >> out[i];
+    }
+  }));
+  bad += check("std::stringstream");
+
+  report("std::strtod", bench::time_it(reps,[&]{
+    for (unsigned i=0; i<n; ++i)
+      out[i] = std::strtod(line.c_str()+pos[i],nullptr);
+  }));
+  bad += check("std::strtod");
+
+  report("ivanp::from_chars", bench::time_it(reps,[&]{
+    const char* p = line.data();
+    const char* const end = p + line.size();
+    for (unsigned i=0; i<n; ++i)
+      p = ivanp::from_chars(p,end,out[i]).ptr + 1;
+  }));
+  bad += check("ivanp::from_chars");
+
+  return bad ? 1 : 0;
+}
@@ -0,0 +1,29 @@
+// Generate synthetic input files
+// Usage: bin/bench_gen hepdata [vars] [bins] [sources] [seed] > file.hepdata
+//        bin/bench_gen modes [modes] [vars] [vals] [bins] [seed] > file.txt
+
+#include <iostream>
+#include <cstring>
+
+#include "bench.hh"
+#include "synth.hh"
+
+using namespace bench;
+
+int main(int argc, char* argv[]) {
+  if (argc>1 && !std::strcmp(argv[1],"hepdata")) {
+    std::cout << synth_hepdata(
+      arg(argc,argv,2,20), arg(argc,argv,3,10), arg(argc,argv,4,40),
+      arg(argc,argv,5,1));
+  } else if (argc>1 && !std::strcmp(argv[1],"modes")) {
+    std::cout << synth_modes(
+      arg(argc,argv,2,7), arg(argc,argv,3,20), arg(argc,argv,4,10),
+      arg(argc,argv,5,10), arg(argc,argv,6,1));
+  } else {
+    std::cerr << "usage: " << argv[0]
+      << " hepdata [vars] [bins] [sources] [seed]\n"
+         "       " << argv[0]
+      << " modes [modes] [vars] [vals] [bins] [seed]" << std::endl;
+    return 1;
+  }
+}
@@ -0,0 +1,48 @@
+// HepData parser throughput, with and without the binary cache
+// Usage: bin/bench_parse [vars] [bins] [sources] [repetitions]
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+
+#include "bench.hh"
+#include "synth.hh"
+#include "hepdata.hh"
+
+using namespace bench;
+
+int main(int argc, char* argv[]) {
+  const unsigned nvars = arg(argc,argv,1,200),
+                 nbins = arg(argc,argv,2,20),
+                 nsrc  = arg(argc,argv,3,60),
+                 reps  = arg(argc,argv,4,5);
+
+  const std::string contents = synth_hepdata(nvars,nbins,nsrc);
+  const std::string file = write_temp(contents);
+  const std::string cache_dir = file + "_cache";
+  ::setenv("XDG_CACHE_HOME",cache_dir.c_str(),1);
+
+  const std::string size = "vars=" + std::to_string(nvars)
+    + ",bins=" + std::to_string(nbins) + ",sources=" + std::to_string(nsrc);
+
+  const unsigned hw = std::thread::hardware_concurrency();
+  std::vector<unsigned> threads { 1 };
+  if (hw >= 2) threads.push_back(2);
+  if (hw > 2) threads.push_back(hw);
+  for (unsigned t : threads) {
+    report("parse", size+",threads="+std::to_string(t),
+      contents.size(), "bytes", time_it(reps,[&]{
+        hepdata::read(file.c_str(),t,hepdata::cache_mode::off);
+      }));
+  }
+
+  hepdata::read(file.c_str(),1,hepdata::cache_mode::rebuild);
+  report("parse", size+",cache", contents.size(), "bytes", time_it(reps,[&]{
+    hepdata::read(file.c_str(),1,hepdata::cache_mode::use);
+  }));
+
+  std::system(("rm -rf '"+file+"' '"+cache_dir+"'").c_str());
+}
@@ -0,0 +1,76 @@
+// Quadrature sums of uncertainty bands, as done by make_bands
+// Times the former scalar passes (group sums, partial sums in quadrature,
+// division by cross section) and the fused SIMD kernel on the same columns,
+// for grids of bins x sources up to 10^6 values
+// Usage: bin/bench_quad [max values] [repetitions]
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <random>
+#include <cmath>
+
+#include "bench.hh"
+#include "simd.hh"
+
+using namespace bench;
+
+template <typename T> constexpr T sq(T x) noexcept { return x*x; }
+
+int main(int argc, char* argv[]) {
+  const unsigned max  = arg(argc,argv,1,1000000),
+                 reps = arg(argc,argv,2,5);
+
+  std::mt19937 gen(1);
+  std::uniform_real_distribution<double> val(0.,10.);
+
+  const std::vector<std::pair<unsigned,unsigned>> grids { // bins, sources
+    {20,60}, {100,100}, {1000,100}, {100,1000}, {1000,1000}
+  };
+  for (const auto& grid : grids) {
+    const unsigned nbins = grid.first, nsrc = grid.second;
+    if (double(nbins)*nsrc > max) continue;
+    const std::string size = "bins=" + std::to_string(nbins)
+      + ",sources=" + std::to_string(nsrc);
+
+    // columns: lumi, correction factor sources, fit, bkg, then stat
+    std::vector<double> unc(size_t(nbins)*(nsrc+1)), xsec(nbins);
+    for (auto& x : unc) x = val(gen);
+    for (auto& x : xsec) x = 100. + val(gen);
+    std::vector<const double*> cols(nsrc+1);
+    for (unsigned c=0; c<=nsrc; ++c) cols[c] = unc.data() + size_t(c)*nbins;
+    const unsigned first[] = { 0, 1, nsrc-2, nsrc, nsrc+1 };
+
+    // scalar passes, with bins in rows, as in plot before the kernel
+    std::vector<std::vector<double>> tuncs_s(4,std::vector<double>(nbins));
+    const double t_scalar = time_it(reps,[&]{
+      std::vector<std::vector<double>> uncs(nbins);
+      std::vector<double> cf(nbins);
+      for (unsigned c=first[1]; c<first[2]; ++c)
+        for (unsigned i=0; i<nbins; ++i) cf[i] += sq(cols[c][i]);
+      for (unsigned i=0; i<nbins; ++i)
+        uncs[i] = { cols[0][i], std::sqrt(cf[i]),
+          std::sqrt(sq(cols[nsrc-2][i])+sq(cols[nsrc-1][i])), cols[nsrc][i] };
+      for (auto& u : uncs)
+        for (unsigned j=1; j<u.size(); ++j)
+          u[j] = std::sqrt(sq(u[j])+sq(u[j-1]));
+      for (unsigned i=0; i<nbins; ++i)
+        for (auto& u : uncs[i]) u /= xsec[i];
+      for (unsigned j=0; j<4; ++j)
+        for (unsigned i=0; i<nbins; ++i) tuncs_s[j][i] = uncs[i][j];
+    });
+
+    std::vector<std::vector<double>> tuncs_v(4,std::vector<double>(nbins));
+    double* out[4];
+    for (unsigned j=0; j<4; ++j) out[j] = tuncs_v[j].data();
+    const double t_simd = time_it(reps,[&]{
+      ivanp::simd::quad_bands(cols.data(),first,4,nbins,xsec.data(),out);
+    });
+
+    if (tuncs_s!=tuncs_v)
+      std::cerr << "\033[31m" << size << ": results differ\033[0m" << std::endl;
+    const double n = double(nbins)*(nsrc+1);
+    report("quad.scalar", size, n, "values", t_scalar);
+    report("quad.simd", size, n, "values", t_simd);
+  }
+}
@@ -0,0 +1,86 @@
+// Summation of production modes, as done by read --vals
+// Times the scalar loop and the SIMD kernel on the same rows, and the whole
+// bin/read run on a synthetic file, if bin/read is next to this program
+// Usage: bin/bench_read [modes] [vars] [vals] [bins] [repetitions]
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <random>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <unistd.h>
+
+#include "bench.hh"
+#include "synth.hh"
+#include "simd.hh"
+
+using namespace bench;
+
+int main(int argc, char* argv[]) {
+  const unsigned nmodes = arg(argc,argv,1,7),
+                 nvars  = arg(argc,argv,2,200),
+                 nvals  = arg(argc,argv,3,20),
+                 nbins  = arg(argc,argv,4,20),
+                 reps   = arg(argc,argv,5,5);
+
+  const std::string size = "modes=" + std::to_string(nmodes)
+    + ",vars=" + std::to_string(nvars) + ",vals=" + std::to_string(nvals)
+    + ",bins=" + std::to_string(nbins);
+
+  // values of all modes, in the order they would be in the arena
+  std::vector<double> arena(size_t(nvars)*nvals*nmodes*nbins);
+  { std::mt19937 gen(1);
+    std::uniform_real_distribution<double> val(0.,100.);
+    for (auto& x : arena) x = val(gen);
+  }
+  const size_t nsums = size_t(nvars)*nvals;
+  std::vector<const double*> rows(nsums*nmodes);
+  for (size_t s=0; s<nsums; ++s)
+    for (unsigned m=0; m<nmodes; ++m)
+      rows[s*nmodes+m] = arena.data() + ((s*nmodes+m)*nbins);
+  std::vector<double> out(nsums*nbins), ref(nsums*nbins);
+
+  report("read.sum", size+",scalar", double(nsums)*nbins, "bins",
+    time_it(reps,[&]{
+      for (size_t s=0; s<nsums; ++s) {
+        double* xs = ref.data() + s*nbins;
+        for (unsigned i=0; i<nbins; ++i) xs[i] = 0;
+        for (unsigned m=0; m<nmodes; ++m) {
+          const double* row = rows[s*nmodes+m];
+          for (unsigned i=0; i<nbins; ++i) xs[i] += row[i];
+        }
+      }
+    }));
+
+  report("read.sum", size+",simd", double(nsums)*nbins, "bins",
+    time_it(reps,[&]{
+      for (size_t s=0; s<nsums; ++s)
+        ivanp::simd::sum_rows(
+          rows.data()+s*nmodes, nmodes, nbins, out.data()+s*nbins);
+    }));
+  if (std::memcmp(out.data(),ref.data(),out.size()*sizeof(double))) {
+    std::cerr << "SIMD sums differ from scalar sums" << std::endl;
+    return 1;
+  }
+
+  // whole program
+  std::string read = argv[0];
+  read = read.substr(0,read.rfind('/')+1) + "read";
+  if (!::access(read.c_str(),X_OK)) {
+    const auto contents = synth_modes(nmodes,nvars,nvals,nbins);
+    const auto file = write_temp(contents);
+    std::string cmd = read + " " + file + " -v";
+    for (unsigned x=0; x<nvals; ++x) cmd += " val" + std::to_string(x);
+    cmd += " > /dev/null";
+    report("read", size, contents.size(), "bytes", time_it(reps,[&]{
+      if (std::system(cmd.c_str())) {
+        std::cerr << cmd << " failed" << std::endl;
+        std::exit(1);
+      }
+    }));
+    std::remove(file.c_str());
+  }
+}
@@ -0,0 +1,113 @@
+// ROOT rendering of uncertainty bands, drawing and SaveAs timed separately
+// Drawing is timed with new histograms for every plot, with a pool, and
+// in compact mode, where bands are drawn as polygons
+// Usage: bin/bench_render [vars] [bins] [sources] [repetitions]
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include <TCanvas.h>
+#include <TAxis.h>
+#include <TGraph.h>
+
+#include <sys/stat.h>
+
+#include "bench.hh"
+#include "synth.hh"
+#include "hepdata.hh"
+#include "uncert.hh"
+#include "bands.hh"
+
+using namespace bench;
+
+int main(int argc, char* argv[]) {
+  const unsigned nvars = arg(argc,argv,1,20),
+                 nbins = arg(argc,argv,2,20),
+                 nsrc  = arg(argc,argv,3,60),
+                 reps  = arg(argc,argv,4,3);
+
+  const std::string file = write_temp(synth_hepdata(nvars,nbins,nsrc));
+  const auto data = hepdata::read(file.c_str());
+  std::remove(file.c_str());
+
+  std::vector<hepdata::bands_t> bands;
+  for (const auto& var : data.vars)
+    bands.push_back(hepdata::make_bands(data,var.first,var.second,false));
+
+  const std::string size = "vars=" + std::to_string(nvars)
+    + ",bins=" + std::to_string(nbins);
+  const std::string pdf = file + ".pdf";
+
+  TCanvas canv;
+  // draw bands of every variable, the same way as plot does
+  std::vector<std::array<h_ptr,3>> hists;
+  std::vector<std::unique_ptr<TGraph>> polygons;
+  hist_pool pool;
+  auto draw = [&](const hepdata::bands_t& b, hist_pool* pool, bool compact){
+    hists.clear();
+    polygons.clear();
+    for (const auto& unc : b.tuncs) {
+      auto band = make_band(b.edges,unc,pool);
+      if (compact) {
+        hists.push_back({{ std::move(band) }});
+        continue;
+      }
+      auto outline = make_outline(band.get(),pool);
+      hists.push_back({{ std::move(band),
+        std::move(std::get<0>(outline)), std::move(std::get<1>(outline)) }});
+    }
+    hists.back()[0]->GetYaxis()->SetRangeUser(-1,1);
+    if (compact) {
+      hists.back()[0]->Draw("AXIS");
+      for (unsigned i=hists.size(); i; ) {
+        polygons.push_back(make_polygon(hists[--i][0].get()));
+        polygons.back()->Draw("LF");
+      }
+    } else {
+      hists.back()[0]->Draw("E2");
+      for (unsigned i=hists.size(); i; ) {
+        --i;
+        for (unsigned j=0; j<3; ++j)
+          hists[i][j]->Draw(j ? "same" : "E2same");
+      }
+    }
+  };
+
+  // time drawing and saving of each page separately
+  using clock = std::chrono::steady_clock;
+  for (int mode : { 0, 1, 2 }) { // new histograms, pool, compact
+    hist_pool* p = mode ? &pool : nullptr;
+    const bool compact = mode==2;
+    double t_draw = 0, t_save = 0;
+    for (unsigned r=0; r<reps; ++r) {
+      std::chrono::duration<double> draw_sum { }, save_sum { };
+      std::remove(pdf.c_str());
+      canv.SaveAs((pdf+"[").c_str());
+      for (const auto& b : bands) {
+        const auto t0 = clock::now();
+        draw(b,p,compact);
+        const auto t1 = clock::now();
+        canv.SaveAs(pdf.c_str());
+        const auto t2 = clock::now();
+        draw_sum += t1-t0;
+        save_sum += t2-t1;
+      }
+      canv.SaveAs((pdf+"]").c_str());
+      if (r==0 || draw_sum.count() < t_draw) t_draw = draw_sum.count();
+      if (r==0 || save_sum.count() < t_save) t_save = save_sum.count();
+    }
+    const auto case_name = size + (compact ? ",compact" : p ? ",pool" : "");
+    report("render.draw", case_name, nvars, "plots", t_draw);
+    report("render.saveas", case_name, nvars, "plots", t_save);
+    struct stat st;
+    if (!::stat(pdf.c_str(),&st))
+      report("render.pdf", case_name, st.st_size, "bytes", t_save);
+  }
+  hists.clear();
+  polygons.clear();
+  std::remove(pdf.c_str());
+}
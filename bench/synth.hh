@@ -0,0 +1,119 @@
+#ifndef BENCH_SYNTH_HH
+#define BENCH_SYNTH_HH
+
+// Synthetic inputs for benchmarks
+
+#include <string>
+#include <random>
+#include <stdexcept>
+#include <cstdio>
+#include <cstdlib>
+
+#include <unistd.h>
+
+namespace bench {
+
+// HepData file with nvars variables of nbins bins, each with lumi, fit,
+// bkg_model_uncorr and nsrc correction factor DSYS sources
+// Variables are named as in plot, so that labels can be found
+inline std::string synth_hepdata(
+  unsigned nvars, unsigned nbins, unsigned nsrc, unsigned seed = 1
+) {
+  static const char* names[] = {
+    "N_j_30", "N_j_50", "pT_yy", "pTt_yy", "pT_yyjj_30", "HT_30", "yAbs_yy",
+    "yAbs_j1_30", "yAbs_j2_30", "Dphi_j_j_30", "Dphi_j_j_30_signed",
+    "Dphi_yy_jj_30", "pT_j1_30", "pT_j2_30", "cosTS_yy", "m_jj_30",
+    "Dy_j_j_30", "Dy_y_y", "maxTau_yyj_30", "sumTau_yyj_30"
+  };
+  static const char* cf[] = {
+    "jes_pu_rho", "gen_model", "jes_flav_comp", "JER", "iso",
+    "pileup", "trig", "PID", "prw", "PES"
+  };
+  constexpr unsigned nnames = sizeof(names)/sizeof(*names),
+                     ncf = sizeof(cf)/sizeof(*cf);
+
+  std::mt19937 gen(seed);
+  std::uniform_real_distribution<double> xsec(1.,10.), rel(0.,0.1),
+                                         srel(-0.1,0.1), u(0.,1.);
+  std::string s = "*comment: synthetic\n\n";
+  char buf[128];
+  for (unsigned v=0; v<nvars; ++v) {
+    if (v<nnames) std::snprintf(buf,sizeof(buf),
+      "*dataset: /HepData/1/d1/%s\n",names[v]);
+    else std::snprintf(buf,sizeof(buf),"*dataset: /HepData/1/d1/var%u\n",v);
+    s += buf;
+    s += "*location: Fig 1\n*yheader: xs\n*data: x : y\n";
+    for (unsigned b=0; b<nbins; ++b) {
+      const double x = xsec(gen);
+      std::snprintf(buf,sizeof(buf),"%u TO %u; %.6g +- %.5g (DSYS=%.5g:lumi",
+        b*10, b*10+10, x, 0.1*x, 0.03*x);
+      s += buf;
+      for (unsigned i=0; i<nsrc; ++i) {
+        std::string name = i<ncf ? cf[i] : "src"+std::to_string(i-ncf);
+        if (u(gen)<0.3) std::snprintf(buf,sizeof(buf),",DSYS=%.5g,%.5g:",
+          srel(gen)*x, srel(gen)*x);
+        else std::snprintf(buf,sizeof(buf),",DSYS=%.5g:",rel(gen)*x);
+        (s += buf) += name;
+      }
+      std::snprintf(buf,sizeof(buf),
+        ",DSYS=%.5g:fit,DSYS=%.5g:bkg_model_uncorr);\n", 0.05*x, 0.02*x);
+      s += buf;
+    }
+    s += "*dataend:\n\n";
+  }
+  return s;
+}
+
+// mode.var.val file for read, with bins and nvals values of nbins bins
+// for every mode and variable
+inline std::string synth_modes(
+  unsigned nmodes, unsigned nvars, unsigned nvals, unsigned nbins,
+  unsigned seed = 1
+) {
+  std::mt19937 gen(seed);
+  std::uniform_real_distribution<double> val(0.,100.);
+  std::string s;
+  char buf[64];
+  for (unsigned v=0; v<nvars; ++v) {
+    for (unsigned m=0; m<nmodes; ++m) {
+      std::snprintf(buf,sizeof(buf),"mode%u.var%u.bins:",m,v);
+      s += buf;
+      for (unsigned b=0; b<=nbins; ++b) {
+        std::snprintf(buf,sizeof(buf)," %u",b*10);
+        s += buf;
+      }
+      s += '\n';
+      for (unsigned x=0; x<nvals; ++x) {
+        std::snprintf(buf,sizeof(buf),"mode%u.var%u.val%u:",m,v,x);
+        s += buf;
+        for (unsigned b=0; b<nbins; ++b) {
+          std::snprintf(buf,sizeof(buf)," %.6g",val(gen));
+          s += buf;
+        }
+        s += '\n';
+      }
+    }
+  }
+  return s;
+}
+
+// write contents to a new temporary file and return its name
+inline std::string write_temp(const std::string& contents) {
+  char name[] = "/tmp/hgam_bench_XXXXXX";
+  const int fd = ::mkstemp(name);
+  if (fd < 0) throw std::runtime_error("cannot create temporary file");
+  for (size_t done = 0; done < contents.size(); ) {
+    const auto n = ::write(fd,contents.data()+done,contents.size()-done);
+    if (n < 0) {
+      ::close(fd);
+      throw std::runtime_error("cannot write temporary file");
+    }
+    done += n;
+  }
+  ::close(fd);
+  return name;
+}
+
+}
+
+#endif
@@ -0,0 +1,61 @@
+// Pseudo-experiments for the standard bands of all variables
+// Times toys on 1 and all hardware threads, and checks that the results
+// don't depend on the number of threads
+// Usage: bin/bench_toys [vars] [bins] [sources] [toys] [repetitions]
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <cstdio>
+
+#include "bench.hh"
+#include "synth.hh"
+#include "hepdata.hh"
+#include "uncert.hh"
+#include "toys.hh"
+
+using namespace bench;
+
+int main(int argc, char* argv[]) {
+  const unsigned nvars = arg(argc,argv,1,20),
+                 nbins = arg(argc,argv,2,20),
+                 nsrc  = arg(argc,argv,3,200),
+                 ntoys = arg(argc,argv,4,20000),
+                 reps  = arg(argc,argv,5,3);
+
+  const std::string file = write_temp(synth_hepdata(nvars,nbins,nsrc));
+  const auto data = hepdata::read(file.c_str());
+  std::remove(file.c_str());
+
+  const std::string size = "vars=" + std::to_string(nvars)
+    + ",bins=" + std::to_string(nbins) + ",sources=" + std::to_string(nsrc);
+  hepdata::groups_t groups = hepdata::default_groups();
+  groups.compile(data.sources);
+  hepdata::toys_config conf;
+  conf.ntoys = ntoys;
+  conf.uncorr = { "bkg_model_uncorr" };
+
+  const unsigned nall = std::thread::hardware_concurrency();
+  std::map<std::string,hepdata::toy_result_t> first;
+  for (unsigned nthreads : { 1u, nall }) {
+    conf.nthreads = nthreads;
+    std::map<std::string,hepdata::toy_result_t> toys;
+    report("toys", size+",threads="+std::to_string(nthreads),
+      ntoys, "toys", time_it(reps,[&]{
+        toys = hepdata::run_toys(data,groups,conf);
+      }));
+    if (first.empty()) first = std::move(toys);
+    else for (const auto& var : first) {
+      const auto& a = var.second;
+      const auto& b = toys.at(var.first);
+      if (a.mean!=b.mean || a.sd!=b.sd ||
+          a.q16!=b.q16 || a.q50!=b.q50 || a.q84!=b.q84) {
+        std::cerr << "\033[31m" << size << ": results differ\033[0m"
+                  << std::endl;
+        break;
+      }
+    }
+    if (nall==1) break;
+  }
+}
@@ -155,7 +155,8 @@ inline auto operator*(const std::tuple<Args...>& args, Pred&& f) {
 }
 
 template <typename Cont, typename Pred>
-inline auto operator|(const Cont& in, Pred f) {
+inline auto operator|(const Cont& in, Pred f)
+-> decltype(ivanp::math::map(in,f)) {
   return ivanp::math::map(in,f);
 }
 
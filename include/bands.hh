@@ -0,0 +1,147 @@
+#ifndef BANDS_HH
+#define BANDS_HH
+
+#include <vector>
+#include <array>
+#include <map>
+#include <memory>
+
+#include <TH1.h>
+#include <TAxis.h>
+#include <TGraph.h>
+
+#include "profile.hh"
+
+// Histograms drawn for each uncertainty band:
+// the band itself, drawn from bin errors, and its upper and lower outlines
+// In compact mode, a band is instead drawn as a single polygon
+
+using h_t = TH1F;
+
+class hist_pool;
+
+// deletes the histogram, or returns it to its pool
+struct hist_release {
+  hist_pool* pool = nullptr;
+  inline void operator()(h_t* h) const;
+};
+using h_ptr = std::unique_ptr<h_t,hist_release>;
+
+// Histograms that are reset and reused instead of being reallocated
+// for every variable
+// Free histograms are kept by binning, and are not added to gDirectory
+class hist_pool {
+  std::map<std::vector<double>,std::vector<std::unique_ptr<h_t>>> free;
+
+public:
+  h_ptr get(unsigned nbins, const double* edges) {
+    auto it = free.find(std::vector<double>(edges,edges+nbins+1));
+    if (it==free.end() || it->second.empty()) {
+      h_t* h = new h_t("","",nbins,edges);
+      h->SetDirectory(nullptr);
+      ivanp::profile::count("histograms created",1);
+      return h_ptr(h,{this});
+    }
+    h_t* h = it->second.back().release();
+    it->second.pop_back();
+    ivanp::profile::count("histograms reused",1);
+    h->Reset();
+    h->UseCurrentStyle();
+    h->SetTitle("");
+    h->SetMinimum(-1111);
+    h->SetMaximum(-1111);
+    for (TAxis* a : { h->GetXaxis(), h->GetYaxis() }) a->SetTitle("");
+    return h_ptr(h,{this});
+  }
+
+  void put(h_t* h) {
+    // bin labels cannot be removed from an axis
+    if (h->GetXaxis()->GetLabels()) { delete h; return; }
+    const TArrayD* xbins = h->GetXaxis()->GetXbins();
+    free[std::vector<double>(
+      xbins->GetArray(), xbins->GetArray()+xbins->GetSize()
+    )].emplace_back(h);
+  }
+};
+
+void hist_release::operator()(h_t* h) const {
+  if (pool) pool->put(h);
+  else delete h;
+}
+
+// without a pool, histograms are allocated and deleted
+inline h_ptr new_hist(
+  hist_pool* pool, unsigned nbins, const double* edges
+) {
+  if (pool) return pool->get(nbins,edges);
+  h_t* h = new h_t("","",nbins,edges);
+  h->SetDirectory(nullptr);
+  ivanp::profile::count("histograms created",1);
+  return h_ptr(h);
+}
+
+inline h_ptr make_band(
+  const std::vector<double>& bins,
+  const std::vector<double>& height,
+  hist_pool* pool = nullptr
+) {
+  h_ptr h = new_hist(pool,bins.size()-1,bins.data());
+  for (unsigned i=0, n=height.size(); i<n; ++i) {
+    h->SetBinError(i+1,height[i]);
+  }
+  h->SetStats(0);
+  h->SetMarkerStyle(0);
+  h->SetLineWidth(1); // gives legend color boxes outlines
+
+  return h;
+}
+
+inline std::array<h_ptr,2> make_outline(h_t* h, hist_pool* pool = nullptr) {
+  auto* xa = h->GetXaxis();
+  const unsigned nbins = h->GetNbinsX();
+  std::array<h_ptr,2> hh {
+    new_hist(pool,nbins,xa->GetXbins()->GetArray()),
+    new_hist(pool,nbins,xa->GetXbins()->GetArray())
+  };
+  for (unsigned i=1; i<=nbins; ++i) {
+    const auto x = h->GetBinError(i);
+    std::get<0>(hh)->SetBinContent(i, x);
+    std::get<1>(hh)->SetBinContent(i,-x);
+  }
+  for (auto& a : hh) {
+    a->SetMarkerStyle(0);
+    a->SetLineWidth(1);
+    a->SetLineColor(1);
+    a->SetLineStyle(h->GetLineStyle());
+    a->SetLineColor(h->GetLineColor());
+  }
+  return hh;
+}
+
+// Band as one closed polygon, to be drawn with "LF":
+// upper edge from left to right, then lower edge from right to left
+inline std::unique_ptr<TGraph> make_polygon(h_t* h) {
+  const unsigned nbins = h->GetNbinsX();
+  const double* edges = h->GetXaxis()->GetXbins()->GetArray();
+  std::unique_ptr<TGraph> g(new TGraph(4*nbins+1));
+  unsigned p = 0;
+  for (unsigned i=0; i<nbins; ++i) {
+    const auto x = h->GetBinError(i+1);
+    g->SetPoint(p++,edges[i  ],x);
+    g->SetPoint(p++,edges[i+1],x);
+  }
+  for (unsigned i=nbins; i; ) {
+    const auto x = h->GetBinError(i--);
+    g->SetPoint(p++,edges[i+1],-x);
+    g->SetPoint(p++,edges[i  ],-x);
+  }
+  g->SetPoint(p,edges[0],h->GetBinError(1)); // close the outline
+  g->SetFillColor(h->GetFillColor());
+  g->SetFillStyle(1001);
+  g->SetLineWidth(1);
+  g->SetLineStyle(h->GetLineStyle());
+  g->SetLineColor(h->GetLineColor());
+  return g;
+}
+
+#endif
@@ -0,0 +1,172 @@
+#ifndef CANVAS_WRITER_HH
+#define CANVAS_WRITER_HH
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <stdexcept>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <TCanvas.h>
+#include <TBufferFile.h>
+
+#include "string.hh"
+
+// Saves canvases in a separate writer process, so that the next plot can
+// be drawn while the previous one is written
+// Canvases are serialized and sent over a socket, and saved in the order
+// in which they were sent. The writer is forked on construction, before
+// any canvases are drawn, and pages of multi-page files are written by it
+// between open() and close()
+class canvas_writer {
+  enum kind : uint8_t { k_open, k_page, k_close };
+  pid_t pid = -1;
+  int sock = -1;
+
+  static bool write_all(int fd, const void* p, size_t n) {
+    for (const char* c = static_cast<const char*>(p); n; ) {
+      const auto w = ::send(fd,c,n,MSG_NOSIGNAL);
+      if (w < 0) {
+        if (errno==EINTR) continue;
+        return false;
+      }
+      c += w, n -= w;
+    }
+    return true;
+  }
+  static bool read_all(int fd, void* p, size_t n) {
+    for (char* c = static_cast<char*>(p); n; ) {
+      const auto r = ::read(fd,c,n);
+      if (r < 0) {
+        if (errno==EINTR) continue;
+        return false;
+      }
+      if (r == 0) return false;
+      c += r, n -= r;
+    }
+    return true;
+  }
+
+  void send(kind k, const std::string& name, const char* data, uint64_t n) {
+    const uint32_t len = name.size();
+    if (!( write_all(sock,&k,sizeof(k))
+        && write_all(sock,&len,sizeof(len))
+        && write_all(sock,name.data(),len)
+        && write_all(sock,&n,sizeof(n))
+        && write_all(sock,data,n) ))
+      throw std::runtime_error(ivanp::cat(
+        "canvas writer: cannot send ",name,": ",std::strerror(errno)));
+  }
+
+  // writer process: save canvases until the socket is closed
+  [[noreturn]] static void serve(int sock) {
+    int status = 0;
+    std::unique_ptr<TCanvas> canv; // last received, also for [ and ]
+    std::string open_name; // multi-page file to open with the next page
+    std::vector<char> data;
+    try {
+      for (kind k; read_all(sock,&k,sizeof(k)); ) {
+        uint32_t len;
+        uint64_t n;
+        if (!read_all(sock,&len,sizeof(len))) break;
+        std::string name(len,'\0');
+        if (!read_all(sock,&name[0],len) || !read_all(sock,&n,sizeof(n)))
+          break;
+        data.resize(n);
+        if (!read_all(sock,data.data(),n)) break;
+
+        switch (k) {
+          case k_open: open_name = std::move(name); break;
+          case k_page: {
+            TBufferFile buf(TBuffer::kRead,n,data.data(),false);
+            canv.reset(dynamic_cast<TCanvas*>(
+              buf.ReadObject(TCanvas::Class())));
+            if (!canv) throw std::runtime_error(ivanp::cat(
+              "canvas writer: cannot read canvas for ",name));
+            if (open_name==name) {
+              canv->SaveAs((name+'[').c_str());
+              open_name.clear();
+            }
+            canv->SaveAs(name.c_str());
+          } break;
+          case k_close:
+            if (!canv) canv.reset(new TCanvas());
+            if (open_name==name) {
+              canv->SaveAs((name+'[').c_str());
+              open_name.clear();
+            }
+            canv->SaveAs((name+']').c_str());
+            break;
+        }
+      }
+    } catch (const std::exception& e) {
+      std::cerr <<"\033[31m"<< e.what() <<"\033[0m"<< std::endl;
+      status = 1;
+    }
+    std::cout.flush();
+    std::cerr.flush();
+    std::fflush(nullptr);
+    ::_exit(status);
+  }
+
+public:
+  canvas_writer() {
+    int fds[2];
+    if (::socketpair(AF_UNIX,SOCK_STREAM,0,fds))
+      throw std::runtime_error(ivanp::cat(
+        "canvas writer: socketpair: ",std::strerror(errno)));
+    // don't let the writer inherit buffered output
+    std::cout.flush();
+    std::cerr.flush();
+    std::fflush(nullptr);
+    pid = ::fork();
+    if (pid < 0) {
+      const int e = errno;
+      ::close(fds[0]);
+      ::close(fds[1]);
+      throw std::runtime_error(ivanp::cat(
+        "canvas writer: fork: ",std::strerror(e)));
+    }
+    if (pid == 0) {
+      ::close(fds[0]);
+      serve(fds[1]);
+    }
+    ::close(fds[1]);
+    sock = fds[0];
+  }
+  ~canvas_writer() { finish(); }
+
+  canvas_writer(const canvas_writer&) = delete;
+  canvas_writer& operator=(const canvas_writer&) = delete;
+
+  // same as SaveAs with "name[", "name" and "name]"
+  void open(const std::string& name) { send(k_open,name,nullptr,0); }
+  void save(const TCanvas& canv, const std::string& name) {
+    TBufferFile buf(TBuffer::kWrite);
+    buf.WriteObject(&canv);
+    send(k_page,name,buf.Buffer(),buf.Length());
+  }
+  void close(const std::string& name) { send(k_close,name,nullptr,0); }
+
+  // wait for all canvases to be saved
+  // returns false if the writer failed
+  bool finish() {
+    if (pid < 0) return true;
+    ::close(sock);
+    int status = 0;
+    pid_t r;
+    while ((r = ::waitpid(pid,&status,0)) < 0 && errno==EINTR) ;
+    pid = -1;
+    return r >= 0 && WIFEXITED(status) && !WEXITSTATUS(status);
+  }
+};
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef COVARIANCE_HH
+#define COVARIANCE_HH
+
+#include <string>
+#include <vector>
+
+#include "hepdata.hh"
+
+namespace hepdata {
+
+// Covariance of cross sections in the bins of several variables,
+// relative to the cross sections
+// Each source is fully correlated between all bins of all variables,
+// and contributes the outer product of its vector of signed shifts.
+// Statistical uncertainties and uncorrelated sources only contribute
+// to the diagonal.
+struct covariance_t {
+  std::vector<std::string> vars;
+  std::vector<unsigned> first; // first bin of each variable, then the size
+  std::vector<bin> bins;       // of all variables
+  std::vector<double> cov;     // size x size, by rows
+
+  unsigned size() const noexcept { return bins.size(); }
+  double operator()(unsigned i, unsigned j) const noexcept {
+    return cov[size_t(i)*size()+j];
+  }
+  // correlation coefficient, 0 if either variance is 0
+  double corr(unsigned i, unsigned j) const noexcept;
+};
+
+// Variables in the given order, or all of them with bins if vars is empty
+// Variables without bins can't be given
+// Products of shift vectors are summed in blocks of bins, on nthreads
+// threads (0 = number of hardware threads). Results don't depend on the
+// number of threads.
+covariance_t covariance(
+  const data_t& data, const std::vector<std::string>& vars,
+  const std::vector<std::string>& uncorr, unsigned nthreads = 1);
+
+}
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef IVANP_FORK_POOL_HH
+#define IVANP_FORK_POOL_HH
+
+#include <iostream>
+#include <vector>
+#include <atomic>
+#include <new>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "string.hh"
+
+namespace ivanp {
+
+// Call f(i) for every i in [0,n) in nproc forked processes
+// For work that cannot be done in threads, e.g. drawing with ROOT
+// Indices are handed out one at a time through a counter in shared memory,
+// so that slow items don't leave processes idle
+// A process stops at the first exception thrown by f
+// done[i] is set for every i for which f returned normally
+// Returns the number of processes that failed
+template <typename F>
+unsigned fork_pool(
+  unsigned n, unsigned nproc, F&& f, std::vector<unsigned char>& done
+) {
+  done.assign(n,0);
+  if (n==0) return 0;
+  if (nproc > n) nproc = n;
+
+  const size_t size = sizeof(std::atomic<unsigned>) + n;
+  void* mem = ::mmap(nullptr,size,PROT_READ|PROT_WRITE,
+                     MAP_SHARED|MAP_ANONYMOUS,-1,0);
+  if (mem==MAP_FAILED) throw std::runtime_error(cat(
+    "mmap: ",std::strerror(errno)));
+  auto* next = new (mem) std::atomic<unsigned>(0);
+  auto* shared_done = static_cast<unsigned char*>(mem) + sizeof(*next);
+  std::memset(shared_done,0,n);
+
+  // don't let children inherit buffered output
+  std::cout.flush();
+  std::cerr.flush();
+
+  std::vector<pid_t> pids;
+  for (unsigned p=0; p<nproc; ++p) {
+    const pid_t pid = ::fork();
+    if (pid < 0) break; // continue with fewer processes
+    if (pid == 0) {
+      int status = 0;
+      try {
+        for (unsigned i; (i = (*next)++) < n; ) {
+          f(i);
+          shared_done[i] = 1;
+        }
+      } catch (const std::exception& e) {
+        std::cerr <<"\033[31m"<< e.what() <<"\033[0m"<< std::endl;
+        status = 1;
+      } catch (...) {
+        status = 1;
+      }
+      std::cout.flush();
+      std::cerr.flush();
+      ::_exit(status);
+    }
+    pids.push_back(pid);
+  }
+  if (pids.empty()) {
+    const int e = errno;
+    ::munmap(mem,size);
+    throw std::runtime_error(cat("fork: ",std::strerror(e)));
+  }
+
+  unsigned failed = 0;
+  for (const pid_t pid : pids) {
+    int status = 0;
+    pid_t r;
+    while ((r = ::waitpid(pid,&status,0)) < 0 && errno==EINTR) ;
+    if (r < 0 || !WIFEXITED(status) || WEXITSTATUS(status)) ++failed;
+  }
+  std::memcpy(done.data(),shared_done,n);
+  ::munmap(mem,size);
+  return failed;
+}
+
+}
+
+#endif
@@ -0,0 +1,138 @@
+#ifndef IVANP_FROM_CHARS_HH
+#define IVANP_FROM_CHARS_HH
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <system_error>
+
+#include <locale.h>
+#ifdef __APPLE__
+#include <xlocale.h>
+#endif
+
+namespace ivanp {
+
+// Locale independent, allocation free conversion of decimal numbers
+// Interface follows std::from_chars from C++17, except that a leading
+// '+' is accepted, like in strtod
+
+struct from_chars_result {
+  const char* ptr;
+  std::errc ec;
+};
+
+namespace detail { namespace from_chars {
+
+constexpr double pow10[] = {
+  1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+inline double strtod_c(const char* str, char** end) noexcept {
+#if defined(__GLIBC__) || defined(__APPLE__)
+  static const locale_t c_locale = newlocale(LC_ALL_MASK,"C",(locale_t)0);
+  return strtod_l(str,end,c_locale);
+#else
+  return std::strtod(str,end);
+#endif
+}
+
+// Correctly rounded conversion by strtod
+// Needed only for more than 19 significant digits, exponents outside
+// of [-22,22], inf and nan
+inline from_chars_result slow(
+  const char* first, const char* last, double& x
+) noexcept {
+  char buf[128];
+  std::string tmp; // only for absurdly long numbers
+  const size_t n = last-first;
+  const char* str;
+  if (n < sizeof(buf)) {
+    std::memcpy(buf,first,n);
+    buf[n] = '\0';
+    str = buf;
+  } else str = (tmp.assign(first,n)).c_str();
+
+  char* end;
+  const int errno0 = errno;
+  errno = 0;
+  const double v = strtod_c(str,&end);
+  const bool range = errno==ERANGE;
+  errno = errno0;
+
+  if (end==str) return { first, std::errc::invalid_argument };
+  if (range) return { first+(end-str), std::errc::result_out_of_range };
+  x = v;
+  return { first+(end-str), std::errc() };
+}
+
+inline bool is_digit(char c) noexcept { return unsigned(c-'0') < 10; }
+
+}}
+
+inline from_chars_result from_chars(
+  const char* first, const char* last, double& x
+) noexcept {
+  using namespace detail::from_chars;
+  const char* p = first;
+  bool neg = false;
+  if (p!=last && (*p=='-' || *p=='+')) neg = (*p++=='-');
+
+  uint64_t m = 0; // up to 19 significant digits
+  int nd = 0, e = 0;
+  bool any = false, trunc = false;
+
+  for (; p!=last && is_digit(*p); ++p) {
+    const unsigned d = *p-'0';
+    any = true;
+    if (nd < 19) { if (m || d) m = m*10 + d, ++nd; }
+    else { ++e; if (d) trunc = true; }
+  }
+  if (p!=last && *p=='.') {
+    for (++p; p!=last && is_digit(*p); ++p) {
+      const unsigned d = *p-'0';
+      any = true;
+      if (nd < 19) { if (m || d) m = m*10 + d, ++nd; --e; }
+      else if (d) trunc = true;
+    }
+  }
+  if (!any) { // maybe inf or nan
+    const char* q = (p!=last && *p=='.') ? p+1 : p;
+    if (q!=last && ((*q|0x20)=='i' || (*q|0x20)=='n'))
+      return slow(first, last-first < 64 ? last : first+64, x);
+    return { first, std::errc::invalid_argument };
+  }
+
+  if (p!=last && (*p|0x20)=='e') {
+    const char* q = p+1;
+    bool eneg = false;
+    if (q!=last && (*q=='-' || *q=='+')) eneg = (*q++=='-');
+    if (q!=last && is_digit(*q)) {
+      int ex = 0;
+      for (; q!=last && is_digit(*q); ++q)
+        if (ex < 100000) ex = ex*10 + (*q-'0');
+      e += eneg ? -ex : ex;
+      p = q;
+    }
+  }
+
+  if (m==0 && !trunc) {
+    x = neg ? -0. : 0.;
+    return { p, std::errc() };
+  }
+  // exact when both operands are exactly representable (Clinger)
+  if (!trunc && m <= (uint64_t(1) << 53) && -22 <= e && e <= 22) {
+    double v = double(m);
+    v = e < 0 ? v / pow10[-e] : v * pow10[e];
+    x = neg ? -v : v;
+    return { p, std::errc() };
+  }
+  return slow(first,p,x);
+}
+
+}
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef IVANP_HASH_HH
+#define IVANP_HASH_HH
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <type_traits>
+
+namespace ivanp {
+
+// Fast 64 bit hash for change detection, not cryptographic
+// Data is consumed 8 bytes at a time
+inline uint64_t hash64(
+  const void* data, size_t n, uint64_t h = 0xcbf29ce484222325
+) noexcept {
+  constexpr uint64_t k = 0x9e3779b97f4a7c15;
+  const char* p = static_cast<const char*>(data);
+  for (; n >= 8; p += 8, n -= 8) {
+    uint64_t w;
+    std::memcpy(&w,p,8);
+    h = (h ^ w) * k;
+    h ^= h >> 32;
+  }
+  if (n) {
+    uint64_t w = 0;
+    std::memcpy(&w,p,n);
+    h = (h ^ w ^ (uint64_t(n) << 59)) * k;
+    h ^= h >> 32;
+  }
+  h *= k;
+  return h ^ (h >> 29);
+}
+
+// Incremental hash of several values
+class hasher {
+  uint64_t h = 0xcbf29ce484222325;
+public:
+  hasher& operator()(const void* data, size_t n) noexcept {
+    h = hash64(data,n,h);
+    return *this;
+  }
+  template <typename T>
+  std::enable_if_t<std::is_trivially_copyable<T>::value,hasher&>
+  operator()(const T& x) noexcept { return (*this)(&x,sizeof(x)); }
+  hasher& operator()(const std::string& s) noexcept {
+    (*this)(s.size());
+    return (*this)(s.data(),s.size());
+  }
+  template <typename T>
+  std::enable_if_t<std::is_trivially_copyable<T>::value,hasher&>
+  operator()(const std::vector<T>& v) noexcept {
+    (*this)(v.size());
+    return (*this)(v.data(),v.size()*sizeof(T));
+  }
+  hasher& operator()(const char* s) noexcept {
+    const size_t n = std::strlen(s);
+    (*this)(n);
+    return (*this)(s,n);
+  }
+
+  uint64_t value() const noexcept { return h; }
+};
+
+}
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef HEPDATA_HH
+#define HEPDATA_HH
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include <boost/utility/string_view.hpp>
+
+#include "interner.hh"
+
+namespace hepdata {
+
+struct bin {
+  double min, max, xsec, stat;
+};
+
+// Names of uncertainty sources, each stored once per run
+// Ids are assigned by dataset blocks in file order, and within a block
+// by sorted source names, not in order of appearance on the lines
+using sources_t = ivanp::interner;
+
+// Bins of one variable
+// Uncertainties are stored as one column of values per source,
+// with columns ordered by source name. Bins for which a source is not
+// given hold 0 and are marked in the presence mask.
+// Asymmetric uncertainties DSYS=a,b are stored as max(|a|,|b|) in unc,
+// and as the signed shift (a-b)/2 in shift, for correlations, and
+// (a+b)/2 in mid, so that the shift for a nuisance parameter x is
+// x*shift + |x|*mid, giving a for x = 1 and b for x = -1.
+// Single values v have shift v and mid 0.
+struct var_t {
+  std::vector<bin> bins;
+  std::vector<unsigned> src;      // source id of each column
+  std::vector<double> unc;        // src.size() columns of bins.size() values
+  std::vector<double> shift, mid; // same layout as unc
+  std::vector<unsigned char> has; // presence mask, same layout as unc
+
+  unsigned nbins() const noexcept { return bins.size(); }
+  unsigned ncols() const noexcept { return src.size(); }
+
+  const double* col(unsigned c) const noexcept {
+    return unc.data() + size_t(c)*bins.size();
+  }
+  const double* col_shift(unsigned c) const noexcept {
+    return shift.data() + size_t(c)*bins.size();
+  }
+  const double* col_mid(unsigned c) const noexcept {
+    return mid.data() + size_t(c)*bins.size();
+  }
+  const unsigned char* col_has(unsigned c) const noexcept {
+    return has.data() + size_t(c)*bins.size();
+  }
+
+  // column of a source or -1 if it is not given for this variable
+  int find(int id) const noexcept {
+    for (unsigned c=0, n=src.size(); c<n; ++c)
+      if (int(src[c])==id) return c;
+    return -1;
+  }
+};
+
+struct data_t {
+  sources_t sources;
+  std::map<std::string,var_t> vars;
+  std::vector<std::string> repeated; // names of skipped repeated datasets
+
+  int find(const var_t& var, boost::string_view source) const {
+    return var.find(sources.find(source));
+  }
+};
+
+// Read bins of every *dataset: block in a HepData file
+// The file is memory mapped and tokenized in place
+// Dataset blocks are located first and then parsed on nthreads threads
+// (0 = number of hardware threads)
+data_t read(const char* file_name, unsigned nthreads = 1);
+
+// Binary cache of parsed files
+// Cache files are stored in $XDG_CACHE_HOME/hgam_plot (~/.cache/hgam_plot)
+// and are used only if size, modification time and hash of the contents
+// of the HepData file are the same as when the cache was written
+enum class cache_mode { use, rebuild, off };
+
+// Same as above, but load the data from cache if it is up to date,
+// otherwise parse the file and write the cache
+data_t read(const char* file_name, unsigned nthreads, cache_mode mode);
+
+}
+
+#endif
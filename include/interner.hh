@@ -0,0 +1,48 @@
+#ifndef IVANP_INTERNER_HH
+#define IVANP_INTERNER_HH
+
+#include <string>
+#include <deque>
+#include <unordered_map>
+
+#include <boost/utility/string_view.hpp>
+#include <boost/functional/hash.hpp>
+
+namespace ivanp {
+
+// Table of strings, each stored once, identified by consecutive ids
+// Ids are assigned in order of insertion
+class interner {
+  std::deque<std::string> names; // stable addresses for the views in ids
+  std::unordered_map<
+    boost::string_view, unsigned, boost::hash<boost::string_view>
+  > ids;
+
+public:
+  interner() = default;
+  interner(interner&&) = default;
+  interner& operator=(interner&&) = default;
+  interner(const interner&) = delete;
+  interner& operator=(const interner&) = delete;
+
+  unsigned intern(boost::string_view name) {
+    const auto it = ids.find(name);
+    if (it!=ids.end()) return it->second;
+    names.emplace_back(name.data(),name.size());
+    const unsigned id = names.size()-1;
+    ids.emplace(names.back(),id);
+    return id;
+  }
+  // id of a string or -1 if it was never interned
+  int find(boost::string_view name) const {
+    const auto it = ids.find(name);
+    return it!=ids.end() ? int(it->second) : -1;
+  }
+
+  const std::string& operator[](unsigned id) const { return names[id]; }
+  unsigned size() const noexcept { return names.size(); }
+};
+
+}
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef IVANP_MANIFEST_HH
+#define IVANP_MANIFEST_HH
+
+#include <string>
+#include <unordered_map>
+#include <fstream>
+#include <stdexcept>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mapped_file.hh"
+#include "tokens.hh"
+
+namespace ivanp {
+
+// Hashes of inputs from which output files were produced
+// Stored as lines of "file hash", with hashes in hex
+class manifest {
+  std::string name;
+  std::unordered_map<std::string,uint64_t> hashes;
+
+public:
+  // a missing or unreadable manifest is treated as empty
+  explicit manifest(std::string file_name): name(std::move(file_name)) {
+    struct stat st;
+    if (::stat(name.c_str(),&st) || !S_ISREG(st.st_mode)) return;
+    try {
+      const mapped_file f(name.c_str());
+      string_view line;
+      for (line_reader next(f.begin(),f.end()); next(line); ) {
+        const auto file = next_word(line);
+        const auto hash = next_word(line);
+        if (file.empty() || hash.empty()) continue;
+        hashes[file.to_string()] = std::strtoull(
+          hash.to_string().c_str(),nullptr,16);
+      }
+    } catch (...) { hashes.clear(); }
+  }
+
+  // true if the output doesn't exist or was made from different inputs
+  bool changed(const std::string& file, uint64_t hash) const {
+    const auto it = hashes.find(file);
+    return it==hashes.end() || it->second!=hash
+        || ::access(file.c_str(),F_OK);
+  }
+
+  void set(const std::string& file, uint64_t hash) { hashes[file] = hash; }
+
+  // write to a temporary file and rename it to replace the manifest
+  void save() const {
+    const std::string tmp_name = cat(name,".tmp",::getpid());
+    { std::ofstream f(tmp_name);
+      char hex[17];
+      for (const auto& h : hashes) {
+        std::snprintf(hex,sizeof(hex),"%016llx",(unsigned long long)h.second);
+        f << h.first << ' ' << hex << '\n';
+      }
+      if (!f.flush()) throw std::runtime_error(cat("cannot write ",tmp_name));
+    }
+    if (std::rename(tmp_name.c_str(),name.c_str())) {
+      std::remove(tmp_name.c_str());
+      throw std::runtime_error(cat("cannot write ",name));
+    }
+  }
+};
+
+}
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef IVANP_MAPPED_FILE_HH
+#define IVANP_MAPPED_FILE_HH
+
+#include <cstring>
+#include <cerrno>
+#include <memory>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "string.hh"
+
+namespace ivanp {
+
+// Read-only view of a whole file
+// Regular files are memory mapped, anything else (pipes, etc.) is read
+// into an owned buffer, so the contents are always one contiguous range
+class mapped_file {
+  const char* m = nullptr;
+  size_t n = 0;
+  bool mapped = false;
+  std::unique_ptr<char[]> buff;
+
+  [[noreturn]] static void fail(const char* what, const char* name, int fd) {
+    const int e = errno;
+    if (fd >= 0) ::close(fd);
+    throw std::runtime_error(cat(what,' ',name,": ",std::strerror(e)));
+  }
+
+public:
+  explicit mapped_file(const char* name) {
+    const int fd = ::open(name,O_RDONLY);
+    if (fd < 0) fail("cannot open",name,fd);
+    struct stat st;
+    if (::fstat(fd,&st)) fail("cannot stat",name,fd);
+
+    if (S_ISREG(st.st_mode)) {
+      n = st.st_size;
+      if (n) {
+        void* p = ::mmap(nullptr,n,PROT_READ,MAP_PRIVATE,fd,0);
+        if (p==MAP_FAILED) fail("cannot mmap",name,fd);
+        ::madvise(p,n,MADV_SEQUENTIAL);
+        m = static_cast<const char*>(p);
+        mapped = true;
+      }
+    } else {
+      size_t cap = 1 << 16;
+      buff.reset(new char[cap]);
+      for (ssize_t r; (r = ::read(fd,buff.get()+n,cap-n)); ) {
+        if (r < 0) {
+          if (errno==EINTR) continue;
+          fail("cannot read",name,fd);
+        }
+        if ((n += r) == cap) {
+          std::unique_ptr<char[]> tmp(new char[cap *= 2]);
+          std::memcpy(tmp.get(),buff.get(),n);
+          buff = std::move(tmp);
+        }
+      }
+      m = buff.get();
+    }
+    ::close(fd);
+  }
+  ~mapped_file() { if (mapped) ::munmap(const_cast<char*>(m),n); }
+
+  mapped_file(const mapped_file&) = delete;
+  mapped_file& operator=(const mapped_file&) = delete;
+
+  inline const char* data() const noexcept { return m; }
+  inline const char* begin() const noexcept { return m; }
+  inline const char* end() const noexcept { return m+n; }
+  inline size_t size() const noexcept { return n; }
+};
+
+}
+
+#endif
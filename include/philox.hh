@@ -0,0 +1,98 @@
+#ifndef IVANP_PHILOX_HH
+#define IVANP_PHILOX_HH
+
+#include <cstdint>
+#include <cmath>
+#include <array>
+#include <algorithm>
+
+namespace ivanp {
+
+// Philox4x32-10 counter-based random number generator
+// (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3", SC11)
+// Each counter gives 4 independent 32 bit numbers for a key, so any
+// number of streams can be generated in any order, e.g. by toy index,
+// without state shared between threads
+class philox {
+  std::array<uint32_t,2> key;
+
+  static void mulhilo(uint32_t a, uint32_t b, uint32_t& hi, uint32_t& lo)
+  noexcept {
+    const uint64_t p = uint64_t(a)*b;
+    hi = p >> 32;
+    lo = uint32_t(p);
+  }
+
+public:
+  using ctr_t = std::array<uint32_t,4>;
+
+  explicit philox(uint64_t seed) noexcept
+  : key{{ uint32_t(seed), uint32_t(seed >> 32) }} { }
+
+  ctr_t operator()(ctr_t c) const noexcept {
+    uint32_t k0 = key[0], k1 = key[1];
+    for (unsigned r=0; r<10; ++r) {
+      uint32_t hi0, lo0, hi1, lo1;
+      mulhilo(0xD2511F53,c[0],hi0,lo0);
+      mulhilo(0xCD9E8D57,c[2],hi1,lo1);
+      c = {{ hi1^c[1]^k0, lo1, hi0^c[3]^k1, lo0 }};
+      k0 += 0x9E3779B9;
+      k1 += 0xBB67AE85;
+    }
+    return c;
+  }
+
+  // two standard normal numbers from two 32 bit numbers,
+  // by the Box-Muller transform
+  static void box_muller(uint32_t a, uint32_t b, double* z) noexcept {
+    constexpr double norm = 1./4294967296., two_pi = 6.283185307179586;
+    const double u1 = (a+0.5)*norm, u2 = (b+0.5)*norm,
+                 r = std::sqrt(-2*std::log(u1));
+    z[0] = r*std::cos(two_pi*u2);
+    z[1] = r*std::sin(two_pi*u2);
+  }
+
+  // n standard normal numbers, 4 from each of the counters
+  // {lo(i), hi(i), c2, c3} for i = first, first+1, ...
+  // Counters are done B at a time, with lanes side by side, so that the
+  // rounds vectorize
+  void normals(uint64_t first, uint32_t c2, uint32_t c3,
+               unsigned n, double* out) const noexcept {
+    constexpr unsigned B = 8;
+    uint32_t c[4][B];
+    for (unsigned i=0; i<n; i+=4*B) {
+      for (unsigned b=0; b<B; ++b) {
+        const uint64_t ctr = first + i/4 + b;
+        c[0][b] = uint32_t(ctr);
+        c[1][b] = uint32_t(ctr >> 32);
+        c[2][b] = c2;
+        c[3][b] = c3;
+      }
+      uint32_t k0 = key[0], k1 = key[1];
+      for (unsigned r=0; r<10; ++r) {
+        for (unsigned b=0; b<B; ++b) {
+          const uint64_t p0 = uint64_t(0xD2511F53)*c[0][b],
+                         p1 = uint64_t(0xCD9E8D57)*c[2][b];
+          const uint32_t x0 = uint32_t(p1 >> 32)^c[1][b]^k0,
+                         x2 = uint32_t(p0 >> 32)^c[3][b]^k1;
+          c[0][b] = x0;
+          c[1][b] = uint32_t(p1);
+          c[2][b] = x2;
+          c[3][b] = uint32_t(p0);
+        }
+        k0 += 0x9E3779B9;
+        k1 += 0xBB67AE85;
+      }
+      double z[4*B];
+      for (unsigned b=0; b<B; ++b) {
+        box_muller(c[0][b],c[1][b],z+4*b);
+        box_muller(c[2][b],c[3][b],z+4*b+2);
+      }
+      std::copy_n(z,std::min(4*B,n-i),out+i);
+    }
+  }
+};
+
+}
+
+#endif
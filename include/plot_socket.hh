@@ -0,0 +1,150 @@
+#ifndef PLOT_SOCKET_HH
+#define PLOT_SOCKET_HH
+
+// Protocol between plot --daemon and plotc
+// The client sends its working directory and arguments, as a length
+// followed by NUL terminated strings, and passes its stdout and stderr
+// with the length, so that the daemon writes to them directly
+// The daemon replies with the exit status as int32_t
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "string.hh"
+
+namespace plot_socket {
+
+// $HGAM_PLOT_SOCKET, $XDG_RUNTIME_DIR/hgam_plot.sock,
+// or /tmp/hgam_plot-UID.sock
+inline std::string default_name() {
+  if (const char* name = std::getenv("HGAM_PLOT_SOCKET")) return name;
+  if (const char* dir = std::getenv("XDG_RUNTIME_DIR"))
+    return ivanp::cat(dir,"/hgam_plot.sock");
+  return ivanp::cat("/tmp/hgam_plot-",::getuid(),".sock");
+}
+
+inline sockaddr_un address(const std::string& name) {
+  sockaddr_un addr { };
+  addr.sun_family = AF_UNIX;
+  if (name.size() >= sizeof(addr.sun_path)) throw std::runtime_error(
+    ivanp::cat("socket name too long: ",name));
+  std::memcpy(addr.sun_path,name.c_str(),name.size()+1);
+  return addr;
+}
+
+inline bool write_all(int fd, const void* p, size_t n) {
+  for (const char* c = static_cast<const char*>(p); n; ) {
+    const auto w = ::write(fd,c,n);
+    if (w < 0) {
+      if (errno==EINTR) continue;
+      return false;
+    }
+    c += w, n -= w;
+  }
+  return true;
+}
+
+inline bool read_all(int fd, void* p, size_t n) {
+  for (char* c = static_cast<char*>(p); n; ) {
+    const auto r = ::read(fd,c,n);
+    if (r < 0) {
+      if (errno==EINTR) continue;
+      return false;
+    }
+    if (r == 0) return false;
+    c += r, n -= r;
+  }
+  return true;
+}
+
+// length and file descriptors go in one message
+inline bool send_with_fds(int sock, uint32_t len, const int (&fds)[2]) {
+  iovec iov { &len, sizeof(len) };
+  char ctrl[CMSG_SPACE(sizeof(fds))] { };
+  msghdr msg { };
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = ctrl;
+  msg.msg_controllen = sizeof(ctrl);
+  cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+  std::memcpy(CMSG_DATA(cmsg),fds,sizeof(fds));
+  ssize_t n;
+  while ((n = ::sendmsg(sock,&msg,0)) < 0 && errno==EINTR) ;
+  return n == sizeof(len);
+}
+
+inline bool recv_with_fds(int sock, uint32_t& len, int (&fds)[2]) {
+  iovec iov { &len, sizeof(len) };
+  char ctrl[CMSG_SPACE(sizeof(fds))] { };
+  msghdr msg { };
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = ctrl;
+  msg.msg_controllen = sizeof(ctrl);
+  ssize_t n;
+  while ((n = ::recvmsg(sock,&msg,0)) < 0 && errno==EINTR) ;
+  cmsghdr* cmsg = n < 0 ? nullptr : CMSG_FIRSTHDR(&msg);
+  size_t nfds = 0;
+  if (cmsg && cmsg->cmsg_level==SOL_SOCKET && cmsg->cmsg_type==SCM_RIGHTS)
+    nfds = (cmsg->cmsg_len - CMSG_LEN(0))/sizeof(int);
+  if (n == sizeof(len) && nfds == 2) {
+    std::memcpy(fds,CMSG_DATA(cmsg),sizeof(fds));
+    return true;
+  }
+  // descriptors received with a bad message
+  for (size_t i=0; i<nfds; ++i) {
+    int fd;
+    std::memcpy(&fd,CMSG_DATA(cmsg)+i*sizeof(int),sizeof(fd));
+    ::close(fd);
+  }
+  return false;
+}
+
+// longest directory and arguments accepted by the daemon
+constexpr uint32_t max_request = 1u << 20;
+
+inline bool send_request(
+  int sock, const std::vector<std::string>& strs, const int (&fds)[2]
+) {
+  std::string buf;
+  for (const auto& s : strs) (buf += s) += '\0';
+  return send_with_fds(sock,buf.size(),fds)
+      && write_all(sock,buf.data(),buf.size());
+}
+
+inline bool recv_request(
+  int sock, std::vector<std::string>& strs, int (&fds)[2]
+) {
+  uint32_t len;
+  if (!recv_with_fds(sock,len,fds)) return false;
+  std::string buf;
+  if (len <= max_request) buf.resize(len);
+  if (len > max_request || !read_all(sock,&buf[0],len)) {
+    ::close(fds[0]);
+    ::close(fds[1]);
+    return false;
+  }
+  strs.clear();
+  for (size_t a = 0, b; a < buf.size(); a = b+1) {
+    b = buf.find('\0',a);
+    if (b==std::string::npos) b = buf.size();
+    strs.emplace_back(buf,a,b-a);
+  }
+  return true;
+}
+
+}
+
+#endif
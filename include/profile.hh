@@ -0,0 +1,212 @@
+#ifndef IVANP_PROFILE_HH
+#define IVANP_PROFILE_HH
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <utility>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+
+#include <unistd.h>
+
+#include "string.hh"
+
+namespace ivanp { namespace profile {
+
+// Timed phases and counters of one run, for --profile
+// Disabled by default, in which case timers and counters do nothing
+// Phases may be timed on any thread, and nested
+class profiler {
+public:
+  using clock = std::chrono::steady_clock;
+  struct event {
+    const char* name;
+    std::string arg; // e.g. variable name
+    clock::time_point begin, end;
+    unsigned tid;
+  };
+
+private:
+  bool on = false;
+  clock::time_point start;
+  std::mutex mx;
+  std::vector<event> events;
+  std::vector<std::pair<std::string,uint64_t>> counters; // in order of use
+  std::vector<std::thread::id> threads;
+
+  unsigned tid(std::thread::id id) { // small thread numbers, from 0
+    const auto it = std::find(threads.begin(),threads.end(),id);
+    if (it!=threads.end()) return it-threads.begin();
+    threads.push_back(id);
+    return threads.size()-1;
+  }
+
+public:
+  bool enabled() const noexcept { return on; }
+
+  // start a new profile, discarding the previous one
+  void enable(bool e = true) {
+    on = e;
+    start = clock::now();
+    events.clear();
+    counters.clear();
+    threads.clear();
+    tid(std::this_thread::get_id());
+  }
+
+  void add(const char* name, std::string arg,
+           clock::time_point begin, clock::time_point end) {
+    std::lock_guard<std::mutex> lock(mx);
+    events.push_back({name,std::move(arg),begin,end,
+                      tid(std::this_thread::get_id())});
+  }
+
+  void count(const char* name, uint64_t n) {
+    std::lock_guard<std::mutex> lock(mx);
+    for (auto& c : counters)
+      if (c.first==name) { c.second += n; return; }
+    counters.emplace_back(name,n);
+  }
+
+  // Total, mean and longest time of each phase, the slowest variables,
+  // and counters
+  void report(std::ostream& os) {
+    std::lock_guard<std::mutex> lock(mx);
+    using ms = std::chrono::duration<double,std::milli>;
+    const double wall = ms(clock::now()-start).count();
+
+    struct stats { unsigned n = 0; double total = 0, max = 0; };
+    std::vector<std::pair<const char*,stats>> phases; // in order of use
+    std::map<std::string,double> by_arg;
+    for (const auto& e : events) {
+      const double t = ms(e.end-e.begin).count();
+      auto it = std::find_if(phases.begin(),phases.end(),
+        [&](const auto& p){ return !strcmp(p.first,e.name); });
+      if (it==phases.end())
+        it = phases.emplace(phases.end(),e.name,stats{});
+      auto& s = it->second;
+      ++s.n, s.total += t;
+      if (t > s.max) s.max = t;
+      if (!e.arg.empty()) by_arg[e.arg] += t;
+    }
+
+    const auto flags = os.flags();
+    const auto prec = os.precision();
+    os << std::fixed << std::setprecision(3)
+       << "\033[1mprofile\033[0m, wall time " << wall << " ms\n"
+       << std::left << std::setw(16) << "phase" << std::right
+       << std::setw(8) << "calls" << std::setw(13) << "total ms"
+       << std::setw(12) << "mean ms" << std::setw(12) << "max ms" << '\n';
+    for (const auto& p : phases)
+      os << std::left << std::setw(16) << p.first << std::right
+         << std::setw(8) << p.second.n
+         << std::setw(13) << p.second.total
+         << std::setw(12) << p.second.total/p.second.n
+         << std::setw(12) << p.second.max << '\n';
+
+    if (!by_arg.empty()) {
+      std::vector<std::pair<std::string,double>> args(
+        by_arg.begin(),by_arg.end());
+      std::stable_sort(args.begin(),args.end(),
+        [](const auto& a, const auto& b){ return a.second > b.second; });
+      const unsigned n = std::min<size_t>(args.size(),10);
+      os << "slowest " << n << " of " << args.size() << " variables:\n";
+      for (unsigned i=0; i<n; ++i)
+        os << "  " << std::left << std::setw(22) << args[i].first
+           << std::right << std::setw(12) << args[i].second << " ms\n";
+    }
+
+    for (const auto& c : counters)
+      os << std::left << std::setw(22) << c.first << std::right
+         << std::setw(14) << c.second << '\n';
+    os.flags(flags);
+    os.precision(prec);
+    os.flush();
+  }
+
+  // Chrome trace event format, to be viewed in chrome://tracing or Perfetto
+  // Phases are complete events on their threads, counters are given at the
+  // end of the profile
+  void write_trace(const std::string& file_name) {
+    std::lock_guard<std::mutex> lock(mx);
+    using us = std::chrono::duration<double,std::micro>;
+    std::ofstream f(file_name);
+    if (!f) throw std::runtime_error(cat("cannot write ",file_name));
+    const auto pid = ::getpid();
+    f << std::fixed << std::setprecision(3) << "{\"traceEvents\":[";
+    bool first = true;
+    auto str = [](const std::string& s){
+      std::string out = "\"";
+      for (char c : s) {
+        if (c=='"' || c=='\\') out += '\\';
+        out += c;
+      }
+      return out += '"';
+    };
+    for (const auto& e : events) {
+      f << (first ? "\n" : ",\n") << "{\"name\":" << str(e.name)
+        << ",\"ph\":\"X\",\"pid\":" << pid << ",\"tid\":" << e.tid
+        << ",\"ts\":" << us(e.begin-start).count()
+        << ",\"dur\":" << us(e.end-e.begin).count();
+      if (!e.arg.empty()) f << ",\"args\":{\"var\":" << str(e.arg) << '}';
+      f << '}';
+      first = false;
+    }
+    const double end = us(clock::now()-start).count();
+    for (const auto& c : counters) {
+      f << (first ? "\n" : ",\n") << "{\"name\":" << str(c.first)
+        << ",\"ph\":\"C\",\"pid\":" << pid << ",\"ts\":" << end
+        << ",\"args\":{\"value\":" << c.second << "}}";
+      first = false;
+    }
+    f << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    if (!f) throw std::runtime_error(cat("cannot write ",file_name));
+  }
+};
+
+inline profiler& get() {
+  static profiler p;
+  return p;
+}
+
+inline void count(const char* name, uint64_t n) {
+  auto& p = get();
+  if (p.enabled()) p.count(name,n);
+}
+
+// Times its scope, or until stop() is called
+class timer {
+  profiler* p;
+  const char* name;
+  std::string arg;
+  profiler::clock::time_point begin;
+
+public:
+  explicit timer(const char* name): timer(name,std::string()) { }
+  timer(const char* name, const std::string& arg)
+  : p(get().enabled() ? &get() : nullptr), name(name) {
+    if (p) this->arg = arg, begin = profiler::clock::now();
+  }
+  timer(const timer&) = delete;
+  timer& operator=(const timer&) = delete;
+  ~timer() { stop(); }
+
+  void stop() {
+    if (!p) return;
+    p->add(name,std::move(arg),begin,profiler::clock::now());
+    p = nullptr;
+  }
+};
+
+}}
+
+#endif
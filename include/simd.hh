@@ -0,0 +1,197 @@
+#ifndef IVANP_SIMD_HH
+#define IVANP_SIMD_HH
+
+#include <cstring>
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+
+// Portable SIMD kernels written with GCC/Clang vector extensions
+// They compile to whatever vector instructions the target has
+// (SSE2 by default on x86-64, AVX with -mavx, NEON on ARM)
+
+namespace ivanp { namespace simd {
+
+#ifdef __AVX__
+constexpr unsigned width = 4;
+#else
+constexpr unsigned width = 2;
+#endif
+typedef double vd __attribute__((vector_size(width*sizeof(double))));
+
+inline vd load(const double* p) noexcept {
+  vd x;
+  std::memcpy(&x,p,sizeof(x));
+  return x;
+}
+inline void store(double* p, vd x) noexcept {
+  std::memcpy(p,&x,sizeof(x));
+}
+inline vd broadcast(double a) noexcept {
+  vd x;
+  for (unsigned k=0; k<width; ++k) x[k] = a;
+  return x;
+}
+
+// Correctly rounded, the same as std::sqrt
+inline vd sqrt(vd x) noexcept {
+#if defined(__AVX__)
+  return (vd)_mm256_sqrt_pd((__m256d)x);
+#elif defined(__SSE2__)
+  return (vd)_mm_sqrt_pd((__m128d)x);
+#else
+  for (unsigned k=0; k<width; ++k) x[k] = std::sqrt(x[k]);
+  return x;
+#endif
+}
+
+inline vd abs(vd x) noexcept {
+  for (unsigned k=0; k<width; ++k) x[k] = std::abs(x[k]);
+  return x;
+}
+
+// out[i] = rows[0][i] + rows[1][i] + ... + rows[nrows-1][i]
+// Rows are added in order, so results are identical to the scalar loop
+inline void sum_rows(
+  const double* const* rows, unsigned nrows, size_t n, double* out
+) noexcept {
+  if (!nrows) {
+    std::fill(out,out+n,0.);
+    return;
+  }
+  size_t i = 0;
+  for (; i+width<=n; i+=width) {
+    vd acc = load(rows[0]+i);
+    for (unsigned r=1; r<nrows; ++r) acc += load(rows[r]+i);
+    store(out+i,acc);
+  }
+  for (; i<n; ++i) {
+    double acc = rows[0][i];
+    for (unsigned r=1; r<nrows; ++r) acc += rows[r][i];
+    out[i] = acc;
+  }
+}
+
+namespace detail {
+
+// quad_bands for K*width bins starting at i
+// Columns are read K vectors at a time, so that wide groups are
+// streamed through the cache
+template <unsigned K>
+inline void quad_bands_block(
+  const double* const* cols, const unsigned* first, unsigned ngroups,
+  size_t i, const double* norm, double* const* out
+) noexcept {
+  vd t[K], s[K];
+  for (unsigned g=0; g<ngroups; ++g) {
+    if (first[g+1]-first[g]==1) {
+      for (unsigned k=0; k<K; ++k)
+        s[k] = abs(load(cols[first[g]]+i+k*width));
+    } else {
+      for (unsigned k=0; k<K; ++k) s[k] = broadcast(0);
+      for (unsigned c=first[g]; c<first[g+1]; ++c) {
+        for (unsigned k=0; k<K; ++k) {
+          const vd x = load(cols[c]+i+k*width);
+          s[k] += x*x;
+        }
+      }
+      for (unsigned k=0; k<K; ++k) s[k] = sqrt(s[k]);
+    }
+    for (unsigned k=0; k<K; ++k) {
+      t[k] = g ? sqrt(s[k]*s[k] + t[k]*t[k]) : s[k];
+      store(out[g]+i+k*width,t[k]/load(norm+i+k*width));
+    }
+  }
+}
+
+}
+
+// Cumulative sums in quadrature of groups of columns, relative to norm
+// Group g is made of columns cols[first[g]], ..., cols[first[g+1]-1],
+// of n values each. For every i, with s_g the sqrt of the sum of squares
+// of the group's values, or the absolute value for groups of one column,
+//   t_0 = s_0,  t_g = sqrt(s_g^2 + t_{g-1}^2),  out[g][i] = t_g / norm[i]
+// All groups are done in one pass over the bins, with operations in the
+// same order as in the scalar loop
+inline void quad_bands(
+  const double* const* cols, const unsigned* first, unsigned ngroups,
+  size_t n, const double* norm, double* const* out
+) noexcept {
+  constexpr unsigned K = 8;
+  size_t i = 0;
+  for (; i+K*width<=n; i+=K*width)
+    detail::quad_bands_block<K>(cols,first,ngroups,i,norm,out);
+  for (; i+width<=n; i+=width)
+    detail::quad_bands_block<1>(cols,first,ngroups,i,norm,out);
+  for (; i<n; ++i) {
+    double t = 0;
+    for (unsigned g=0; g<ngroups; ++g) {
+      double s;
+      if (first[g+1]-first[g]==1) s = std::abs(cols[first[g]][i]);
+      else {
+        double acc = 0;
+        for (unsigned c=first[g]; c<first[g+1]; ++c) {
+          const double x = cols[c][i];
+          acc += x*x;
+        }
+        s = std::sqrt(acc);
+      }
+      t = g ? std::sqrt(s*s + t*t) : s;
+      out[g][i] = t/norm[i];
+    }
+  }
+}
+
+// Sums of products of rows, as in a matrix product a^T b
+// For R rows of c, r < R, and j from j0 to j0+n,
+//   c[r][j] += a[0][i+r]*b[0][j] + ... + a[nrows-1][i+r]*b[nrows-1][j]
+// with products added to c in order, the same as the scalar loop.
+// R x 2 vectors of c are kept in registers while rows are streamed.
+template <unsigned R>
+inline void outer_sums(
+  const double* const* a, const double* const* b, unsigned nrows,
+  size_t i, size_t j0, size_t n, double* const* c
+) noexcept {
+  constexpr unsigned M = 2;
+  const size_t end = j0+n;
+  size_t j = j0;
+  for (; j+M*width<=end; j+=M*width) {
+    vd acc[R][M];
+    for (unsigned r=0; r<R; ++r)
+      for (unsigned m=0; m<M; ++m) acc[r][m] = load(c[r]+j+m*width);
+    for (unsigned k=0; k<nrows; ++k) {
+      const double *ak = a[k], *bk = b[k];
+      vd x[M];
+      for (unsigned m=0; m<M; ++m) x[m] = load(bk+j+m*width);
+      for (unsigned r=0; r<R; ++r) {
+        const vd y = broadcast(ak[i+r]);
+        for (unsigned m=0; m<M; ++m) acc[r][m] += y*x[m];
+      }
+    }
+    for (unsigned r=0; r<R; ++r)
+      for (unsigned m=0; m<M; ++m) store(c[r]+j+m*width,acc[r][m]);
+  }
+  for (; j<end; ++j)
+    for (unsigned r=0; r<R; ++r) {
+      double acc = c[r][j];
+      for (unsigned k=0; k<nrows; ++k) acc += a[k][i+r]*b[k][j];
+      c[r][j] = acc;
+    }
+}
+
+// Same with a = b, as in a covariance matrix of shift vectors
+template <unsigned R>
+inline void outer_sums(
+  const double* const* rows, unsigned nrows,
+  size_t i, size_t j0, size_t n, double* const* c
+) noexcept {
+  outer_sums<R>(rows,rows,nrows,i,j0,n,c);
+}
+
+}}
+
+#endif
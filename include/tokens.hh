@@ -0,0 +1,73 @@
+#ifndef IVANP_TOKENS_HH
+#define IVANP_TOKENS_HH
+
+#include <cstring>
+#include <cctype>
+#include <stdexcept>
+
+#include <boost/utility/string_view.hpp>
+
+#include "from_chars.hh"
+#include "string.hh"
+
+namespace ivanp {
+
+using boost::string_view;
+
+// split contiguous buffer into lines, like std::getline
+class line_reader {
+  const char *p, *end;
+public:
+  line_reader(const char* p, const char* end): p(p), end(end) { }
+  bool operator()(string_view& line) noexcept {
+    if (p==end) return false;
+    const char* nl = static_cast<const char*>(std::memchr(p,'\n',end-p));
+    const char* e = nl ? nl : end;
+    line = { p, size_t(e-p) };
+    p = nl ? nl+1 : end;
+    return true;
+  }
+};
+
+inline void skip_space(string_view& s) noexcept {
+  size_t a = 0;
+  for (const size_t n = s.size(); a<n && std::isspace(s[a]); ) ++a;
+  s.remove_prefix(a);
+}
+
+// next whitespace delimited word, like operator>>
+inline string_view next_word(string_view& s) noexcept {
+  skip_space(s);
+  size_t b = 0;
+  for (const size_t n = s.size(); b<n && !std::isspace(s[b]); ) ++b;
+  const auto w = s.substr(0,b);
+  s.remove_prefix(b);
+  return w;
+}
+
+// next number, like operator>>
+// returns false and leaves s unchanged if there isn't one
+inline bool next_double(string_view& s, double& x) noexcept {
+  auto t = s;
+  skip_space(t);
+  const auto r = from_chars(t.begin(),t.end(),x);
+  if (r.ec!=std::errc()) return false;
+  s = { r.ptr, size_t(t.end()-r.ptr) };
+  return true;
+}
+
+// same as std::stod, but without creating a string
+inline double to_double(string_view s) {
+  skip_space(s);
+  double x;
+  const auto r = from_chars(s.begin(),s.end(),x);
+  if (r.ec==std::errc::invalid_argument) throw std::invalid_argument(cat(
+    "cannot convert \"",s,"\" to double"));
+  if (r.ec==std::errc::result_out_of_range) throw std::out_of_range(cat(
+    "\"",s,"\" is out of range of double"));
+  return x;
+}
+
+}
+
+#endif
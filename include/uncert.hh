@@ -0,0 +1,115 @@
+#ifndef UNCERT_HH
+#define UNCERT_HH
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <iosfwd>
+
+#include "hepdata.hh"
+
+namespace hepdata {
+
+// Uncertainty bands of one variable
+// Each band is the sum in quadrature of its own and all previous
+// contributions, relative to the cross section
+struct bands_t {
+  std::vector<double> edges;
+  std::vector<std::vector<double>> tuncs; // [band][bin]
+  std::vector<unsigned> corr_selected, corr_other; // columns
+};
+
+// Groups of sources combined in quadrature into the bands of the
+// standard view, with their legend labels and styles
+// Sources are given by names or shell patterns; @stat is the statistical
+// uncertainty of the bins. Sources named without wildcards belong to their
+// group, and with a leading ! must also be given in every bin. Other
+// sources belong to the first group with a matching pattern, or to a group
+// with * if none matches.
+struct group_t {
+  std::string name, label;
+  int fill, line, style; // colors and line style
+  std::vector<std::string> patterns;
+};
+
+class groups_t {
+  std::vector<group_t> groups;
+  // compiled against sources
+  unsigned nsources = 0;
+  std::vector<int> of_source; // group of each source id, or -1
+  // required sources of each group: id (-1 if not in data) and pattern index
+  std::vector<std::vector<std::pair<int,unsigned>>> required;
+  std::vector<char> stat;
+
+public:
+  groups_t() = default;
+  explicit groups_t(std::vector<group_t> groups);
+
+  unsigned size() const noexcept { return groups.size(); }
+  const group_t& operator[](unsigned i) const { return groups[i]; }
+  auto begin() const noexcept { return groups.begin(); }
+  auto end() const noexcept { return groups.end(); }
+
+  // Resolve patterns to source ids, once for all variables of the data
+  void compile(const sources_t& sources);
+  bool compiled(const sources_t& sources) const noexcept {
+    return nsources == sources.size() && of_source.size() == nsources;
+  }
+  // after compile
+  int group_of(unsigned source_id) const noexcept {
+    return of_source[source_id];
+  }
+  bool has_stat(unsigned g) const noexcept { return stat[g]; }
+
+  friend bands_t make_bands(
+    const data_t&, const std::string&, const var_t&, const groups_t&);
+};
+
+// lumi, correction factor (everything else), signal extraction
+// (fit and bkg_model_uncorr) and stat
+const groups_t& default_groups();
+
+// Group definitions, one group per line:
+// name fill line style "label" source...
+// Colors are ROOT color numbers or names with offsets, e.g. kAzure-6
+// Lines starting with # are comments
+groups_t read_groups(const char* file_name);
+
+// Correction factor sources drawn separately with corr
+// By default, these are the n largest contributions to each variable,
+// by the sum of squares of relative uncertainties in all bins
+struct corr_t {
+  unsigned n = 4;
+  std::vector<unsigned> sources; // ids from rank_sources, if not empty
+};
+
+// Ids of the n largest correction factor sources over all variables,
+// from the smallest
+std::vector<unsigned> rank_sources(const data_t& data, unsigned n);
+
+// Without corr, bands are those of default_groups(), compiled on every call
+// With corr, bands are the 4 largest correction factor contributions and
+// the rest combined; values of the selected ones are written to log
+bands_t make_bands(
+  const data_t& data, const std::string& name, const var_t& var,
+  bool corr, std::ostream* log = nullptr);
+
+// Bands of selected correction factor sources, from the smallest,
+// and the rest combined
+bands_t make_bands(
+  const data_t& data, const std::string& name, const var_t& var,
+  const corr_t& corr, std::ostream* log = nullptr);
+
+// One band for each group, which must be compiled for data.sources
+bands_t make_bands(
+  const data_t& data, const std::string& name, const var_t& var,
+  const groups_t& groups);
+
+// Replace cross sections with values read from file, e.g. SM predictions
+// Each line is a variable name followed by the cross section in every bin
+// Throws if a variable is missing or has a different number of bins
+void read_xsec(data_t& data, const char* file_name);
+
+}
+
+#endif
@@ -0,0 +1,139 @@
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+#include <atomic>
+
+#include "covariance.hh"
+#include "string.hh"
+#include "simd.hh"
+#include "profile.hh"
+
+using namespace ivanp;
+
+namespace hepdata {
+
+double covariance_t::corr(unsigned i, unsigned j) const noexcept {
+  const double d = (*this)(i,i) * (*this)(j,j);
+  return d > 0 ? (*this)(i,j)/std::sqrt(d) : 0;
+}
+
+covariance_t covariance(
+  const data_t& data, const std::vector<std::string>& vars,
+  const std::vector<std::string>& uncorr, unsigned nthreads
+) {
+  profile::timer timer("covariance");
+  covariance_t out;
+  std::vector<const var_t*> vs;
+  if (vars.empty()) for (const auto& var : data.vars) {
+    if (!var.second.nbins()) continue; // empty datasets
+    out.vars.push_back(var.first);
+    vs.push_back(&var.second);
+  } else for (const auto& name : vars) {
+    const auto it = data.vars.find(name);
+    if (it==data.vars.end()) throw std::runtime_error(cat(
+      "no variable ",name));
+    if (!it->second.nbins()) throw std::runtime_error(cat(
+      "no bins in variable ",name));
+    out.vars.push_back(name);
+    vs.push_back(&it->second);
+  }
+  for (const var_t* var : vs) {
+    out.first.push_back(out.bins.size());
+    out.bins.insert(out.bins.end(),var->bins.begin(),var->bins.end());
+  }
+  out.first.push_back(out.bins.size());
+  const size_t n = out.size();
+  if (!n) throw std::runtime_error("no bins for covariance");
+
+  // one row of relative shifts in all bins for each correlated source,
+  // in order of first use by the variables and their sorted columns
+  const unsigned nsources = data.sources.size();
+  std::vector<char> is_uncorr(nsources);
+  for (const auto& name : uncorr) {
+    const int id = data.sources.find(name);
+    if (id >= 0) is_uncorr[id] = true;
+  }
+  std::vector<int> row_of(nsources,-1);
+  unsigned nrows = 0;
+  for (const var_t* var : vs)
+    for (unsigned id : var->src)
+      if (!is_uncorr[id] && row_of[id] < 0) row_of[id] = nrows++;
+
+  std::vector<double> shifts(size_t(nrows)*n), diag(n);
+  for (unsigned v=0; v<vs.size(); ++v) {
+    const var_t& var = *vs[v];
+    const auto& bins = var.bins;
+    const unsigned o = out.first[v], nbins = var.nbins();
+    for (unsigned i=0; i<nbins; ++i) {
+      const double x = bins[i].stat/bins[i].xsec;
+      diag[o+i] += x*x;
+    }
+    for (unsigned c=0; c<var.ncols(); ++c) {
+      const double* s = var.col_shift(c);
+      const unsigned char* has = var.col_has(c);
+      const unsigned id = var.src[c];
+      if (is_uncorr[id]) {
+        for (unsigned i=0; i<nbins; ++i)
+          if (has[i]) {
+            const double x = s[i]/bins[i].xsec;
+            diag[o+i] += x*x;
+          }
+      } else {
+        double* row = shifts.data() + size_t(row_of[id])*n + o;
+        for (unsigned i=0; i<nbins; ++i)
+          row[i] = has[i] ? s[i]/bins[i].xsec : 0.;
+      }
+    }
+  }
+  profile::count("shift vectors",nrows);
+
+  // sums of products of shifts, in tiles of B x B bins on or above the
+  // diagonal, with rows of shifts streamed KB at a time
+  constexpr unsigned B = 64, KB = 128;
+  auto& cov = out.cov;
+  cov.assign(n*n,0.);
+  const unsigned ntiles = (n+B-1)/B;
+  std::vector<std::pair<unsigned,unsigned>> tiles;
+  for (unsigned a=0; a<ntiles; ++a)
+    for (unsigned b=a; b<ntiles; ++b) tiles.emplace_back(a,b);
+  std::vector<const double*> rows(nrows);
+  for (unsigned k=0; k<nrows; ++k) rows[k] = shifts.data() + size_t(k)*n;
+
+  std::atomic<unsigned> next_tile{0};
+  auto worker = [&]{
+    for (unsigned t; (t = next_tile++) < tiles.size(); ) {
+      const size_t i0 = size_t(tiles[t].first)*B, i1 = std::min(i0+B,n),
+                   j0 = size_t(tiles[t].second)*B, nj = std::min(j0+B,n)-j0;
+      double* c[4];
+      for (unsigned k=0; k<nrows; k+=KB) {
+        const unsigned nk = std::min(KB,nrows-k);
+        size_t i = i0;
+        for (; i+4<=i1; i+=4) {
+          for (unsigned r=0; r<4; ++r) c[r] = cov.data() + (i+r)*n;
+          simd::outer_sums<4>(rows.data()+k,nk,i,j0,nj,c);
+        }
+        for (; i<i1; ++i) {
+          c[0] = cov.data() + i*n;
+          simd::outer_sums<1>(rows.data()+k,nk,i,j0,nj,c);
+        }
+      }
+    }
+  };
+
+  if (nthreads==0) nthreads = std::thread::hardware_concurrency();
+  nthreads = std::max(1u,std::min<unsigned>(nthreads,tiles.size()));
+  std::vector<std::thread> threads;
+  for (unsigned i=1; i<nthreads; ++i) threads.emplace_back(worker);
+  worker();
+  for (auto& t : threads) t.join();
+
+  for (size_t i=0; i<n; ++i) {
+    for (size_t j=0; j<i; ++j) cov[i*n+j] = cov[j*n+i];
+    cov[i*n+i] += diag[i];
+  }
+
+  return out;
+}
+
+}
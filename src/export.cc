@@ -0,0 +1,372 @@
+// Write uncertainty bands, as drawn by plot, without drawing them
+// Bands of every variable are written as CSV, JSON or binary,
+// to be used by other programs
+// With --cov, write covariance and correlation matrices of bins instead
+// With --toys, the standard bands are from pseudo-experiments
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <array>
+#include <limits>
+#include <memory>
+#include <cstdint>
+#include <cstdio>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#include "program_options.hh"
+#include "hepdata.hh"
+#include "uncert.hh"
+#include "covariance.hh"
+#include "toys.hh"
+#include "string.hh"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+using namespace ivanp;
+
+// Group definitions of the standard bands, compiled for the data
+hepdata::groups_t groups;
+// Sources of separate bands with corr
+hepdata::corr_t corr_sel;
+// Results of pseudo-experiments, with --toys
+std::map<std::string,hepdata::toy_result_t> toys;
+
+hepdata::bands_t make_bands(
+  const hepdata::data_t& data, const std::pair<const std::string,
+  hepdata::var_t>& var, bool corr
+) {
+  if (corr) return hepdata::make_bands(data,var.first,var.second,corr_sel);
+  if (!toys.empty()) return toys.at(var.first).bands();
+  return hepdata::make_bands(data,var.first,var.second,groups);
+}
+
+// Band names, in the same order as the bands
+std::vector<std::string> band_names(
+  const hepdata::data_t& data, const hepdata::var_t& var,
+  const hepdata::bands_t& b, bool corr
+) {
+  std::vector<std::string> names;
+  if (!corr) {
+    for (const auto& g : groups) names.push_back(g.name);
+    return names;
+  }
+  for (unsigned c : b.corr_selected)
+    names.emplace_back(data.sources[var.src[c]]);
+  names.emplace_back("others");
+  return names;
+}
+
+// One row per bin of every band
+// variable,band,bin,min,max,value
+void write_csv(
+  std::ostream& os, const hepdata::data_t& data, bool corr
+) {
+  os << "variable,band,bin,min,max,value\n";
+  for (const auto& var : data.vars) {
+    const auto b = make_bands(data,var,corr);
+    const auto names = band_names(data,var.second,b,corr);
+    for (unsigned i=0; i<b.tuncs.size(); ++i)
+      for (unsigned j=0; j<b.tuncs[i].size(); ++j)
+        os << var.first <<','<< names[i] <<','<< j <<','
+           << b.edges[j] <<','<< b.edges[j+1] <<','<< b.tuncs[i][j] <<'\n';
+  }
+}
+
+// JSON has no nan or inf
+void json_value(std::ostream& os, double x) {
+  if (std::isfinite(x)) os << x;
+  else os << "null";
+}
+void json_value(std::ostream& os, const std::string& s) { os << s; }
+
+template <typename C>
+void json_array(std::ostream& os, const C& xs) {
+  os << '[';
+  bool first = true;
+  for (const auto& x : xs) {
+    if (!first) os << ',';
+    first = false;
+    json_value(os,x);
+  }
+  os << ']';
+}
+
+std::string json_str(const std::string& s) {
+  std::string out = "\"";
+  for (char c : s) {
+    if (c=='"' || c=='\\') (out += '\\') += c;
+    else if ((unsigned char)c < 0x20) {
+      char buf[8];
+      std::snprintf(buf,sizeof(buf),"\\u%04x",(unsigned char)c);
+      out += buf;
+    } else out += c;
+  }
+  return out += '"';
+}
+
+// {"corr":false,"variables":{"VAR":{"edges":[...],"bands":[
+//   {"name":"lumi","values":[...]}, ...],"others":[...]}}}
+// "others" lists sources combined in the last band, only with corr
+// Values that are not finite, e.g. with a zero cross section, are null
+void write_json(
+  std::ostream& os, const hepdata::data_t& data, bool corr
+) {
+  os.precision(std::numeric_limits<double>::max_digits10);
+  os << "{\"corr\":" << (corr ? "true" : "false") << ",\"variables\":{";
+  bool first = true;
+  for (const auto& var : data.vars) {
+    const auto b = make_bands(data,var,corr);
+    const auto names = band_names(data,var.second,b,corr);
+    if (!first) os << ',';
+    first = false;
+    os << '\n' << json_str(var.first) << ":{\"edges\":";
+    json_array(os,b.edges);
+    os << ",\"bands\":[";
+    for (unsigned i=0; i<b.tuncs.size(); ++i) {
+      if (i) os << ',';
+      os << "\n  {\"name\":" << json_str(names[i]) << ",\"values\":";
+      json_array(os,b.tuncs[i]);
+      os << '}';
+    }
+    os << ']';
+    if (corr) {
+      std::vector<std::string> others;
+      for (unsigned c : b.corr_other)
+        others.push_back(json_str(data.sources[var.second.src[c]]));
+      os << ",\"others\":";
+      json_array(os,others);
+    }
+    os << '}';
+  }
+  os << "\n}}\n";
+}
+
+// Binary layout, in the same conventions as the parse cache:
+// every field starts at an 8 byte boundary, strings and arrays are preceded
+// by their length as uint64_t, numbers are in native byte order
+// header: magic "HGAMBAND", uint32_t version, uint32_t 0x01020304,
+//         uint64_t corr, uint64_t number of variables
+// each variable: name, edges (double), number of bands, then for each band:
+//                name, values (double)
+class bin_writer {
+  std::ostream& os;
+  void raw(const void* p, size_t n) {
+    static const char zeros[8] { };
+    os.write(static_cast<const char*>(p),n);
+    os.write(zeros,(8-n%8)%8);
+  }
+public:
+  bin_writer(std::ostream& os): os(os) { }
+  template <typename T>
+  void put(const T& x) { raw(&x,sizeof(x)); }
+  void put_str(const std::string& s) {
+    put<uint64_t>(s.size());
+    raw(s.data(),s.size());
+  }
+  void put_vec(const std::vector<double>& v) {
+    put<uint64_t>(v.size());
+    raw(v.data(),v.size()*sizeof(double));
+  }
+};
+
+void write_bin(
+  std::ostream& os, const hepdata::data_t& data, bool corr
+) {
+  bin_writer w(os);
+  constexpr char magic[8] = { 'H','G','A','M','B','A','N','D' };
+  w.put(magic);
+  w.put(std::array<uint32_t,2>{{ 1, 0x01020304 }});
+  w.put<uint64_t>(corr);
+  w.put<uint64_t>(data.vars.size());
+  for (const auto& var : data.vars) {
+    const auto b = make_bands(data,var,corr);
+    const auto names = band_names(data,var.second,b,corr);
+    w.put_str(var.first);
+    w.put_vec(b.edges);
+    w.put<uint64_t>(b.tuncs.size());
+    for (unsigned i=0; i<b.tuncs.size(); ++i) {
+      w.put_str(names[i]);
+      w.put_vec(b.tuncs[i]);
+    }
+  }
+}
+
+// Covariance matrices -----------------------------------------------
+
+// One row per pair of bins
+// variable1,bin1,variable2,bin2,covariance,correlation
+void write_cov_csv(std::ostream& os, const hepdata::covariance_t& cov) {
+  os << "variable1,bin1,variable2,bin2,covariance,correlation\n";
+  for (unsigned a=0; a<cov.vars.size(); ++a)
+    for (unsigned i=cov.first[a]; i<cov.first[a+1]; ++i)
+      for (unsigned b=0; b<cov.vars.size(); ++b)
+        for (unsigned j=cov.first[b]; j<cov.first[b+1]; ++j)
+          os << cov.vars[a] <<','<< i-cov.first[a] <<','
+             << cov.vars[b] <<','<< j-cov.first[b] <<','
+             << cov(i,j) <<','<< cov.corr(i,j) <<'\n';
+}
+
+std::vector<double> edges(
+  const hepdata::covariance_t& cov, unsigned v
+) {
+  std::vector<double> e;
+  if (cov.first[v]==cov.first[v+1]) return e;
+  for (unsigned i=cov.first[v]; i<cov.first[v+1]; ++i)
+    e.push_back(cov.bins[i].min);
+  e.push_back(cov.bins[cov.first[v+1]-1].max);
+  return e;
+}
+
+// {"variables":[{"name":"VAR","first":0,"edges":[...]}, ...],
+//  "covariance":[[...], ...],"correlation":[[...], ...]}
+// Rows and columns are bins of all variables, from "first" of each
+// Values that are not finite are null
+void write_cov_json(std::ostream& os, const hepdata::covariance_t& cov) {
+  os.precision(std::numeric_limits<double>::max_digits10);
+  os << "{\"variables\":[";
+  for (unsigned v=0; v<cov.vars.size(); ++v) {
+    if (v) os << ',';
+    os << "\n{\"name\":" << json_str(cov.vars[v])
+       << ",\"first\":" << cov.first[v] << ",\"edges\":";
+    json_array(os,edges(cov,v));
+    os << '}';
+  }
+  for (const bool is_cov : { true, false }) {
+    os << "],\n\"" << (is_cov ? "covariance" : "correlation") << "\":[";
+    std::vector<double> row(cov.size());
+    for (unsigned i=0; i<cov.size(); ++i) {
+      for (unsigned j=0; j<cov.size(); ++j)
+        row[j] = is_cov ? cov(i,j) : cov.corr(i,j);
+      if (i) os << ',';
+      os << '\n';
+      json_array(os,row);
+    }
+  }
+  os << "]}\n";
+}
+
+// header: magic "HGAMCOVM", uint32_t version, uint32_t 0x01020304,
+//         uint64_t number of variables
+// each variable: name, edges (double)
+// then covariance and correlation (double), as arrays of size x size values
+void write_cov_bin(std::ostream& os, const hepdata::covariance_t& cov) {
+  bin_writer w(os);
+  constexpr char magic[8] = { 'H','G','A','M','C','O','V','M' };
+  w.put(magic);
+  w.put(std::array<uint32_t,2>{{ 1, 0x01020304 }});
+  w.put<uint64_t>(cov.vars.size());
+  for (unsigned v=0; v<cov.vars.size(); ++v) {
+    w.put_str(cov.vars[v]);
+    w.put_vec(edges(cov,v));
+  }
+  w.put_vec(cov.cov);
+  std::vector<double> corr(cov.cov.size());
+  for (unsigned i=0, k=0; i<cov.size(); ++i)
+    for (unsigned j=0; j<cov.size(); ++j, ++k) corr[k] = cov.corr(i,j);
+  w.put_vec(corr);
+}
+
+int main(int argc, char* argv[]) {
+  const char *data_file_name, *sig_fid_SM_file_name = nullptr,
+             *out_name = nullptr, *format = nullptr,
+             *groups_file_name = nullptr;
+  bool corr = false, corr_global = false, no_cache = false,
+       rebuild_cache = false, cov = false;
+  std::vector<const char*> cov_vars, uncorr_args;
+  unsigned nthreads = 1;
+  hepdata::toys_config toys_conf;
+  toys_conf.ntoys = 0;
+
+  try {
+    using namespace ivanp::po;
+    if (program_options()
+      (data_file_name,'f',"",req(),pos(1))
+      (sig_fid_SM_file_name,"--SM","divide by σfidSM",pos(1))
+      (corr,"corr","")
+      (corr_sel.n,"--corr-n","with corr, N largest sources (default: 4)")
+      (corr_global,"--corr-global",
+       "with corr, select sources by all variables together")
+      (groups_file_name,{"-g","--groups"},"file with groups of sources")
+      (out_name,{"-o","--output"},"output file (default: stdout)")
+      (format,"--format","csv, json or bin (default: from -o, or csv)")
+      (cov,"--cov","write covariance and correlation of bins")
+      (cov_vars,"--vars","with --cov, variables to include (default: all)",
+       multi())
+      (toys_conf.ntoys,"--toys","bands from N pseudo-experiments")
+      (toys_conf.seed,"--seed","with --toys, random seed (default: 1)")
+      (uncorr_args,"--uncorr",
+       "with --cov or --toys, sources uncorrelated between bins"
+       " (default: bkg_model_uncorr)",multi())
+      (nthreads,{"-t","--threads"},
+       "parse datasets, sum covariance and run toys on N threads (0 = all)")
+      (no_cache,"--no-cache","don't use binary cache of parsed input")
+      (rebuild_cache,"--rebuild-cache","reparse input and rewrite cache")
+      .parse(argc,argv,true)) return 0;
+  } catch (const std::exception& e) {
+    cerr <<"\033[31m"<< e.what() <<"\033[0m"<< endl;
+    return 1;
+  }
+
+  if (!format) {
+    format = "csv";
+    if (out_name) {
+      const char* ext = std::strrchr(out_name,'.');
+      if (ext && (!strcmp(ext,".json") || !strcmp(ext,".bin"))) format = ext+1;
+    }
+  }
+  void (*write)(std::ostream&, const hepdata::data_t&, bool);
+  void (*write_cov)(std::ostream&, const hepdata::covariance_t&);
+  if (!strcmp(format,"csv")) write = write_csv, write_cov = write_cov_csv;
+  else if (!strcmp(format,"json"))
+    write = write_json, write_cov = write_cov_json;
+  else if (!strcmp(format,"bin")) write = write_bin, write_cov = write_cov_bin;
+  else {
+    cerr << "\033[31mUnknown format: " << format << "\033[0m" << endl;
+    return 1;
+  }
+
+  try {
+    auto data = hepdata::read(data_file_name,nthreads,
+      no_cache ? hepdata::cache_mode::off :
+      rebuild_cache ? hepdata::cache_mode::rebuild :
+      hepdata::cache_mode::use);
+    if (sig_fid_SM_file_name)
+      hepdata::read_xsec(data,sig_fid_SM_file_name);
+    groups = groups_file_name ? hepdata::read_groups(groups_file_name)
+                              : hepdata::default_groups();
+    groups.compile(data.sources);
+    if (corr && corr_global)
+      corr_sel.sources = hepdata::rank_sources(data,corr_sel.n);
+    std::vector<std::string> uncorr(uncorr_args.begin(),uncorr_args.end());
+    if (uncorr.empty()) uncorr = { "bkg_model_uncorr" };
+    if (toys_conf.ntoys && !corr && !cov) {
+      toys_conf.nthreads = nthreads;
+      toys_conf.uncorr = uncorr;
+      toys = hepdata::run_toys(data,groups,toys_conf);
+    }
+
+    std::unique_ptr<std::ofstream> file;
+    if (out_name) {
+      file.reset(new std::ofstream(out_name,std::ios::binary));
+      if (!*file) throw std::runtime_error(cat("cannot write ",out_name));
+    }
+    std::ostream& os = file ? *file : cout;
+    os.precision(std::numeric_limits<double>::max_digits10);
+    if (cov) {
+      const std::vector<std::string> vars(cov_vars.begin(),cov_vars.end());
+      write_cov(os,hepdata::covariance(data,vars,uncorr,nthreads));
+    } else write(os,data,corr);
+    os.flush();
+    if (!os) throw std::runtime_error(cat(
+      "cannot write ",out_name ? out_name : "stdout"));
+  } catch (const std::exception& e) {
+    cerr <<"\033[31m"<< e.what() <<"\033[0m"<< endl;
+    return 1;
+  }
+}
@@ -0,0 +1,248 @@
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <unordered_map>
+
+#include "hepdata.hh"
+#include "mapped_file.hh"
+#include "tokens.hh"
+#include "profile.hh"
+
+using std::cerr;
+using std::endl;
+using namespace ivanp;
+
+namespace hepdata {
+
+namespace {
+
+// columns of one variable, created as sources are encountered
+struct columns {
+  var_t& var;
+  const unsigned nbins;
+  std::vector<string_view> names;
+  std::unordered_map<string_view,unsigned,boost::hash<string_view>> index;
+
+  columns(var_t& var): var(var), nbins(var.nbins()) { }
+
+  unsigned operator()(string_view name) {
+    const auto it = index.find(name);
+    if (it!=index.end()) return it->second;
+    const unsigned c = names.size();
+    names.push_back(name);
+    index.emplace(name,c);
+    var.unc.resize(var.unc.size()+nbins);
+    var.shift.resize(var.shift.size()+nbins);
+    var.mid.resize(var.mid.size()+nbins);
+    var.has.resize(var.has.size()+nbins);
+    return c;
+  }
+
+  // reorder columns by source name
+  void sort() {
+    const unsigned ncols = names.size();
+    std::vector<unsigned> order(ncols);
+    std::iota(order.begin(),order.end(),0);
+    std::sort(order.begin(),order.end(),[&](unsigned a, unsigned b){
+      return names[a] < names[b];
+    });
+    std::vector<string_view> names2(ncols);
+    std::vector<double> unc(var.unc.size()), shift(var.shift.size()),
+                        mid(var.mid.size());
+    std::vector<unsigned char> has(var.has.size());
+    for (unsigned c=0; c<ncols; ++c) {
+      const unsigned o = order[c];
+      names2[c] = names[o];
+      std::copy_n(var.unc.begin()+size_t(o)*nbins,nbins,
+                  unc.begin()+size_t(c)*nbins);
+      std::copy_n(var.shift.begin()+size_t(o)*nbins,nbins,
+                  shift.begin()+size_t(c)*nbins);
+      std::copy_n(var.mid.begin()+size_t(o)*nbins,nbins,
+                  mid.begin()+size_t(c)*nbins);
+      std::copy_n(var.has.begin()+size_t(o)*nbins,nbins,
+                  has.begin()+size_t(c)*nbins);
+    }
+    names = std::move(names2);
+    var.unc = std::move(unc);
+    var.shift = std::move(shift);
+    var.mid = std::move(mid);
+    var.has = std::move(has);
+  }
+};
+
+// returns the number of DSYS entries
+unsigned parse_bin(
+  string_view line, columns& cols, unsigned bin_i, unsigned line_n
+) {
+  bin& b = cols.var.bins[bin_i];
+  const auto d1 = line.find(';');
+  auto tok = line.substr(0,d1);
+  bool geq;
+  if ((geq = tok.starts_with(">="))) tok.remove_prefix(2);
+  b.min = to_double(next_word(tok));
+  const auto to = next_word(tok);
+  if (geq) b.max = b.min+1;
+  else if (to=="TO") b.max = to_double(next_word(tok));
+  else b.max = b.min;
+
+  const auto d2 = line.find('(',d1+1);
+  tok = line.substr(d1+1,d2-d1-1);
+  b.xsec = to_double(next_word(tok));
+  if (next_word(tok)!="+-") throw std::runtime_error(cat(
+    "missing +- in bin line ",line_n));
+  b.stat = to_double(next_word(tok));
+
+  unsigned n = 0;
+  for (size_t i=d2+1; ; ++n) {
+    if (i >= line.size()) throw std::runtime_error(cat(
+      "unterminated DSYS list on line ",line_n));
+    if (line[i]==';') break;
+    if (!line.substr(i).starts_with("DSYS")) throw std::runtime_error(cat(
+      "missing DSYS in bin line ",line_n));
+    const auto eq  = line.find('=',i);
+    const auto col = line.find(':',eq+1);
+    auto end = line.find(',',col+1);
+    if (end==string_view::npos) end = line.find(')',col+1);
+    const auto sep = line.substr(eq+1,col-eq-1).find(',');
+
+    const auto unc = line.substr(col+1,end-col-1);
+    const size_t k = size_t(cols(unc))*cols.nbins + bin_i;
+    if (cols.var.has[k]) throw std::runtime_error(cat(
+      "duplicate uncert source \'",unc,"\' on line ",line_n));
+    cols.var.has[k] = true;
+    if (sep==string_view::npos) { // one value
+      cols.var.unc[k] = cols.var.shift[k] =
+        to_double(line.substr(eq+1,col-eq-1));
+    } else {
+      const double a = to_double(line.substr(eq+1,sep)),
+                   b = to_double(line.substr(eq+sep+2,col-eq-sep-2));
+      cols.var.unc[k] = std::max(std::abs(a),std::abs(b));
+      cols.var.shift[k] = (a-b)/2;
+      cols.var.mid[k] = (a+b)/2;
+    }
+
+    i = end+1;
+  }
+  return n;
+}
+
+// contiguous bin lines of one *dataset: block
+struct block {
+  const std::string* name;
+  var_t* var;
+  const char *begin, *end;
+  unsigned line_n; // line number of the first bin
+  std::vector<string_view> names; // source of each column
+};
+
+void parse_block(block& blk) {
+  profile::timer timer("parse",*blk.name);
+  auto& var = *blk.var;
+  var.bins.resize(std::count(blk.begin,blk.end,'\n')+1);
+  columns cols(var);
+  unsigned i = 0, ndsys = 0;
+  string_view line;
+  for (line_reader next(blk.begin,blk.end); next(line); ++i)
+    ndsys += parse_bin(line,cols,i,blk.line_n+i);
+  cols.sort();
+  profile::count("bins",i);
+  profile::count("DSYS tokens",ndsys);
+  blk.names = std::move(cols.names);
+}
+
+} // end anonymous namespace
+
+data_t read(const char* file_name, unsigned nthreads) {
+  profile::timer timer("scan");
+  const mapped_file file(file_name);
+
+  // find dataset boundaries ----------------------------------------
+  data_t data;
+  auto& vars = data.vars;
+  std::vector<block> blocks;
+  bool in_block = false;
+  unsigned line_n = 0;
+  string_view line;
+  for (line_reader next(file.begin(),file.end()); next(line); ) {
+    ++line_n;
+    if (!in_block) {
+      if (line.starts_with("*dataset:")) {
+        const auto name = line.substr(line.rfind('/')+1);
+        const auto emp = vars.emplace(std::piecewise_construct,
+          std::forward_as_tuple(name.data(),name.size()),
+          std::forward_as_tuple()
+        );
+        if (!emp.second) {
+          cerr << "repeated variable: " << emp.first->first << endl;
+          data.repeated.push_back(emp.first->first);
+          continue;
+        }
+        blocks.push_back({
+          &emp.first->first,&emp.first->second,nullptr,nullptr,0,{}});
+        in_block = true;
+      }
+    } else {
+      auto& blk = blocks.back();
+      const bool star = line.starts_with("*");
+      if (!blk.begin && star) continue;
+      if (line.size() && !star) {
+        if (!blk.begin) blk.begin = line.data(), blk.line_n = line_n;
+        blk.end = line.data()+line.size();
+      } else in_block = false;
+    }
+  }
+  blocks.erase(
+    std::remove_if(blocks.begin(),blocks.end(),
+      [](const block& blk){ return !blk.begin; }),
+    blocks.end());
+  profile::count("bytes read",file.size());
+  profile::count("lines",line_n);
+  timer.stop();
+
+  // parse bins -----------------------------------------------------
+  // largest blocks are handed out first for better load balancing
+  std::vector<unsigned> order(blocks.size());
+  std::iota(order.begin(),order.end(),0);
+  std::stable_sort(order.begin(),order.end(),[&](unsigned a, unsigned b){
+    return (blocks[a].end-blocks[a].begin) > (blocks[b].end-blocks[b].begin);
+  });
+
+  std::vector<std::exception_ptr> errors(blocks.size());
+  std::atomic<unsigned> next_block{0};
+  auto worker = [&]{
+    for (unsigned i; (i = next_block++) < order.size(); ) {
+      try {
+        parse_block(blocks[order[i]]);
+      } catch (...) {
+        errors[order[i]] = std::current_exception();
+      }
+    }
+  };
+
+  if (nthreads==0) nthreads = std::thread::hardware_concurrency();
+  nthreads = std::min<unsigned>(nthreads,blocks.size());
+  std::vector<std::thread> threads;
+  for (unsigned i=1; i<nthreads; ++i) threads.emplace_back(worker);
+  worker();
+  for (auto& t : threads) t.join();
+
+  // report the first error in file order, as in sequential parsing
+  for (const auto& e : errors) if (e) std::rethrow_exception(e);
+
+  // intern source names by blocks, sorted within each --------------
+  for (const auto& blk : blocks) {
+    auto& src = blk.var->src;
+    src.reserve(blk.names.size());
+    for (const auto& name : blk.names)
+      src.push_back(data.sources.intern(name));
+  }
+
+  return data;
+}
+
+}
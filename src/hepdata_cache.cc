@@ -0,0 +1,286 @@
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <memory>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "hepdata.hh"
+#include "mapped_file.hh"
+#include "hash.hh"
+#include "profile.hh"
+
+using std::cerr;
+using std::endl;
+using boost::string_view;
+using namespace ivanp;
+
+namespace hepdata {
+
+namespace {
+
+// Cache file layout ------------------------------------------------
+// header, then source names, then for each variable: name, bins,
+// column sources, column values, shifts, mids and presence mask, then
+// names of repeated datasets
+// Every field starts at an 8 byte boundary, so that arrays can be used
+// directly from a mapped file. Strings and arrays are preceded by
+// their length as uint64_t.
+
+constexpr char magic[8] = { 'H','E','P','C','A','C','H','E' };
+constexpr uint32_t version = 3, endian = 0x01020304;
+
+struct header {
+  char magic[8];
+  uint32_t version, endian;
+  uint64_t size;   // of the HepData file
+  int64_t  mtime_sec, mtime_nsec;
+  uint64_t hash;   // of the HepData file contents
+  uint64_t nsources, nvars, nrepeated;
+};
+
+struct file_key {
+  uint64_t size;
+  int64_t mtime_sec, mtime_nsec;
+};
+
+file_key get_key(const struct stat& st) noexcept {
+#ifdef __APPLE__
+  return { uint64_t(st.st_size), st.st_mtimespec.tv_sec, st.st_mtimespec.tv_nsec };
+#else
+  return { uint64_t(st.st_size), st.st_mtim.tv_sec, st.st_mtim.tv_nsec };
+#endif
+}
+
+class writer {
+  std::string buf;
+  void raw(const void* p, size_t n) {
+    buf.append(static_cast<const char*>(p),n);
+    buf.append((8-n%8)%8,'\0');
+  }
+public:
+  template <typename T>
+  void put(const T& x) { raw(&x,sizeof(x)); }
+  void put_str(string_view s) {
+    put<uint64_t>(s.size());
+    raw(s.data(),s.size());
+  }
+  template <typename T>
+  void put_vec(const std::vector<T>& v) {
+    put<uint64_t>(v.size());
+    raw(v.data(),v.size()*sizeof(T));
+  }
+  const std::string& str() const noexcept { return buf; }
+};
+
+class reader {
+  const char *p, *end;
+  const char* take(size_t n) {
+    const size_t padded = n + (8-n%8)%8;
+    if (padded < n || size_t(end-p) < padded)
+      throw std::runtime_error("truncated cache file");
+    const char* q = p;
+    p += padded;
+    return q;
+  }
+public:
+  reader(const char* p, const char* end): p(p), end(end) { }
+  template <typename T>
+  T get() {
+    T x;
+    std::memcpy(&x,take(sizeof(T)),sizeof(T));
+    return x;
+  }
+  string_view get_str() {
+    const auto n = get<uint64_t>();
+    return { take(n), size_t(n) };
+  }
+  template <typename T>
+  void get_vec(std::vector<T>& v) {
+    const auto n = get<uint64_t>();
+    if (n > size_t(end-p)/sizeof(T))
+      throw std::runtime_error("truncated cache file");
+    v.resize(n);
+    std::memcpy(v.data(),take(n*sizeof(T)),n*sizeof(T));
+  }
+  bool done() const noexcept { return p==end; }
+};
+
+// e.g. ~/.cache/hgam_plot/0123456789abcdef.bin
+std::string cache_file_name(const char* path) {
+  std::string dir;
+  if (const char* xdg = std::getenv("XDG_CACHE_HOME")) dir = xdg;
+  else if (const char* home = std::getenv("HOME")) (dir = home) += "/.cache";
+  else return { };
+  ::mkdir(dir.c_str(),0755);
+  dir += "/hgam_plot";
+  ::mkdir(dir.c_str(),0755);
+
+  char hex[17];
+  std::snprintf(hex,sizeof(hex),"%016llx",
+    (unsigned long long)hash64(path,std::strlen(path)));
+  return dir + '/' + hex + ".bin";
+}
+
+bool load(const std::string& cache_name, const char* path,
+          const file_key& key, uint64_t hash, data_t& data) {
+  struct stat st;
+  if (::stat(cache_name.c_str(),&st) || !S_ISREG(st.st_mode)) return false;
+
+  const mapped_file f(cache_name.c_str());
+  profile::count("bytes read",f.size());
+  reader r(f.begin(),f.end());
+
+  const auto h = r.get<header>();
+  if ( std::memcmp(h.magic,magic,sizeof(magic))
+    || h.version != version || h.endian != endian
+    || h.size != key.size
+    || h.mtime_sec != key.mtime_sec || h.mtime_nsec != key.mtime_nsec
+    || h.hash != hash
+    || r.get_str() != path
+  ) return false;
+
+  data_t tmp;
+  for (uint64_t i=0; i<h.nsources; ++i)
+    if (tmp.sources.intern(r.get_str()) != i)
+      throw std::runtime_error("repeated source name");
+
+  for (uint64_t i=0; i<h.nvars; ++i) {
+    const auto name = r.get_str();
+    auto& var = tmp.vars[name.to_string()];
+    r.get_vec(var.bins);
+    r.get_vec(var.src);
+    r.get_vec(var.unc);
+    r.get_vec(var.shift);
+    r.get_vec(var.mid);
+    r.get_vec(var.has);
+    if ( var.unc.size() != var.src.size()*var.bins.size()
+      || var.shift.size() != var.unc.size()
+      || var.mid.size() != var.unc.size()
+      || var.has.size() != var.unc.size()
+    ) throw std::runtime_error("inconsistent column sizes");
+    for (auto s : var.src)
+      if (s >= h.nsources) throw std::runtime_error("bad source id");
+  }
+  for (uint64_t i=0; i<h.nrepeated; ++i)
+    tmp.repeated.push_back(r.get_str().to_string());
+  if (!r.done() || tmp.vars.size() != h.nvars)
+    throw std::runtime_error("unexpected cache contents");
+
+  // same diagnostics as when parsing
+  for (const auto& name : tmp.repeated)
+    cerr << "repeated variable: " << name << endl;
+
+  data = std::move(tmp);
+  return true;
+}
+
+void save(const std::string& cache_name, const char* path,
+          const file_key& key, uint64_t hash, const data_t& data) {
+  writer w;
+  header h { };
+  std::memcpy(h.magic,magic,sizeof(magic));
+  h.version = version;
+  h.endian = endian;
+  h.size = key.size;
+  h.mtime_sec = key.mtime_sec;
+  h.mtime_nsec = key.mtime_nsec;
+  h.hash = hash;
+  h.nsources = data.sources.size();
+  h.nvars = data.vars.size();
+  h.nrepeated = data.repeated.size();
+  w.put(h);
+  w.put_str(path);
+  for (unsigned i=0; i<data.sources.size(); ++i)
+    w.put_str(data.sources[i]);
+  for (const auto& var : data.vars) {
+    w.put_str(var.first);
+    w.put_vec(var.second.bins);
+    w.put_vec(var.second.src);
+    w.put_vec(var.second.unc);
+    w.put_vec(var.second.shift);
+    w.put_vec(var.second.mid);
+    w.put_vec(var.second.has);
+  }
+  for (const auto& name : data.repeated)
+    w.put_str(name);
+
+  // write to a temporary file and rename it to replace the cache atomically
+  const std::string tmp_name = cat(cache_name,".tmp",::getpid());
+  const int fd = ::open(tmp_name.c_str(),O_WRONLY|O_CREAT|O_TRUNC,0644);
+  if (fd < 0) throw std::runtime_error(cat(
+    "cannot write ",tmp_name,": ",std::strerror(errno)));
+  const auto& buf = w.str();
+  for (size_t done = 0; done < buf.size(); ) {
+    const auto n = ::write(fd,buf.data()+done,buf.size()-done);
+    if (n < 0) {
+      if (errno==EINTR) continue;
+      const int e = errno;
+      ::close(fd);
+      ::unlink(tmp_name.c_str());
+      throw std::runtime_error(cat(
+        "cannot write ",tmp_name,": ",std::strerror(e)));
+    }
+    done += n;
+  }
+  ::close(fd);
+  profile::count("cache bytes written",buf.size());
+  if (::rename(tmp_name.c_str(),cache_name.c_str())) {
+    const int e = errno;
+    ::unlink(tmp_name.c_str());
+    throw std::runtime_error(cat(
+      "cannot write ",cache_name,": ",std::strerror(e)));
+  }
+}
+
+} // end anonymous namespace
+
+data_t read(const char* file_name, unsigned nthreads, cache_mode mode) {
+  if (mode==cache_mode::off) return read(file_name,nthreads);
+
+  struct stat st;
+  char* path = nullptr;
+  if ( ::stat(file_name,&st) || !S_ISREG(st.st_mode)
+    || !(path = ::realpath(file_name,nullptr))
+  ) return read(file_name,nthreads); // let read() report the problem
+  const std::unique_ptr<char,decltype(&std::free)> path_ptr(path,std::free);
+
+  const std::string cache_name = cache_file_name(path);
+  if (cache_name.empty()) return read(file_name,nthreads);
+
+  const auto key = get_key(st);
+  uint64_t hash;
+  { profile::timer timer("hash");
+    const mapped_file f(file_name);
+    profile::count("bytes read",f.size());
+    hash = hash64(f.data(),f.size());
+  }
+
+  data_t data;
+  if (mode==cache_mode::use) {
+    try {
+      profile::timer timer("cache load");
+      if (load(cache_name,path,key,hash,data)) return data;
+    } catch (const std::exception& e) {
+      cerr << "\033[33mIgnoring cache " << cache_name << ": "
+           << e.what() << "\033[0m" << endl;
+    }
+  }
+
+  data = read(file_name,nthreads);
+  try {
+    profile::timer timer("cache save");
+    save(cache_name,path,key,hash,data);
+  } catch (const std::exception& e) {
+    cerr << "\033[33m" << e.what() << "\033[0m" << endl;
+  }
+  return data;
+}
+
+}
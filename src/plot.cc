@@ -8,17 +8,42 @@
 #include <cstring>
 #include <memory>
 #include <stdexcept>
+#include <thread>
+#include <cstdlib>
+#include <cerrno>
+#include <csignal>
 
 #include <boost/optional.hpp>
 
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
 #include <TCanvas.h>
 #include <TAxis.h>
 #include <TColor.h>
 #include <TH1.h>
 #include <TLegend.h>
 #include <TLatex.h>
+#include <TGraph.h>
+#include <TH2.h>
+#include <TStyle.h>
 
 #include "program_options.hh"
+#include "hepdata.hh"
+#include "uncert.hh"
+#include "covariance.hh"
+#include "toys.hh"
+#include "bands.hh"
+#include "mapped_file.hh"
+#include "tokens.hh"
+#include "hash.hh"
+#include "manifest.hh"
+#include "fork_pool.hh"
+#include "plot_socket.hh"
+#include "profile.hh"
+#include "canvas_writer.hh"
 
 #include "algebra.hh"
 #include "lists.hh"
@@ -55,152 +80,40 @@ decltype(auto) at(M&& map, const Key& key, int line) {
   } catch (...) { throw; }
 }
 
-using h_t = TH1F;
-using h_ptr = std::unique_ptr<h_t>;
-
-h_ptr make_band(
-  const std::vector<double>& bins,
-  const std::vector<double>& height
-) {
-  h_t *h = new h_t("","",bins.size()-1,bins.data());
-  for (unsigned i=0, n=height.size(); i<n; ++i) {
-    h->SetBinError(i+1,height[i]);
-  }
-  h->SetStats(0);
-  h->SetMarkerStyle(0);
-  h->SetLineWidth(1); // gives legend color boxes outlines
-
-  return h_ptr(h);
-}
-
-std::array<h_ptr,2> make_outline(h_t* h) {
-  auto* xa = h->GetXaxis();
-  const unsigned nbins = h->GetNbinsX();
-  std::array<h_ptr,2> hh {
-    h_ptr(new h_t("","",nbins,xa->GetXbins()->GetArray())),
-    h_ptr(new h_t("","",nbins,xa->GetXbins()->GetArray()))
-  };
-  for (unsigned i=1; i<=nbins; ++i) {
-    const auto x = h->GetBinError(i);
-    get<0>(hh)->SetBinContent(i, x);
-    get<1>(hh)->SetBinContent(i,-x);
-  }
-  for (auto& a : hh) {
-    a->SetMarkerStyle(0);
-    a->SetLineWidth(1);
-    a->SetLineColor(1);
-    a->SetLineStyle(h->GetLineStyle());
-    a->SetLineColor(h->GetLineColor());
-  }
-  return std::move(hh);
-}
-
 struct read_to_map {
   template <typename Map>
   void operator()(const char* arg, boost::optional<Map>& m) {
     m.emplace();
-    std::ifstream f(arg);
-    for ( rm_elements_const_t<typename Map::value_type> x;
-          f >> x.first >> x.second; ) { m->emplace(std::move(x)); }
+    const mapped_file f(arg);
+    string_view s(f.data(),f.size());
+    for (double x; ; ) {
+      const auto key = next_word(s);
+      if (key.empty() || !next_double(s,x)) break;
+      m->emplace(std::piecewise_construct,
+        std::forward_as_tuple(key.data(),key.size()),
+        std::forward_as_tuple(x));
+    }
   }
 };
 
-int main(int argc, char* argv[]) {
-  const char *data_file_name, *sig_fid_SM_file_name = nullptr;
-  bool burst = false, corr = false;
-  boost::optional<std::unordered_map<std::string,double>> ranges_map;
-
+// Parse HepData file and apply --SM cross sections
+int prepare(
+  hepdata::data_t& data,
+  const char* data_file_name, const char* sig_fid_SM_file_name,
+  unsigned nthreads, hepdata::cache_mode mode
+) {
   try {
-    using namespace ivanp::po;
-    if (program_options()
-      (data_file_name,'f',"",req(),pos(1))
-      (sig_fid_SM_file_name,"--SM","divide by σfidSM",pos(1))
-      (burst,"burst","")
-      (corr,"corr","")
-      (ranges_map,{"-r","--range"},"",read_to_map{})
-      .parse(argc,argv,true)) return 0;
+    profile::timer timer("read");
+    data = hepdata::read(data_file_name,nthreads,mode);
   } catch (const std::exception& e) {
     cerr <<"\033[31m"<< e.what() <<"\033[0m"<< endl;
     return 1;
   }
 
-  struct bin {
-    double min, max, xsec, stat;
-    std::map<std::string,double> unc;
-  };
-  std::map<std::string,std::vector<bin>> vars;
-
-  { std::ifstream hepdata(data_file_name);
-  auto it = vars.end();
-  unsigned line_n = 0;
-  for (std::string line, tok; std::getline(hepdata,line); ) {
-    ++line_n;
-    if (it==vars.end()) {
-      if (starts_with(line,"*dataset:")) {
-        const auto emp = vars.emplace(std::piecewise_construct,
-          std::forward_as_tuple(line.substr(line.rfind('/')+1)),
-          tie()
-        );
-        if (!emp.second) {
-          cerr << "repeated variable: " << emp.first->first << endl;
-          continue;
-        }
-        it = emp.first;
-      }
-    } else {
-      const bool star = starts_with(line,"*");
-      if (it->second.size()==0 && star) continue;
-      if (line.size() && !star) {
-        it->second.emplace_back();
-        bin& b = it->second.back();
-
-        const auto d1 = line.find(';');
-        tok = line.substr(0,d1);
-        bool geq;
-        if ((geq = starts_with(tok,">="))) tok.erase(0,2);
-        std::stringstream ss(tok);
-        ss >> b.min >> tok >> b.max;
-        if (geq) b.max = b.min+1;
-        else if (tok!="TO") b.max = b.min;
-
-        const auto d2 = line.find('(',d1+1);
-        ss.clear();
-        ss.str(line.substr(d1+1,d2-d1-1));
-        ss >> b.xsec >> tok >> b.stat;
-        if (tok!="+-") throw std::runtime_error("missing +- in bin line");
-
-        const char* cstr = line.c_str();
-        for (size_t i=d2+1; line[i]!=';'; ) {
-          // cout << cstr+i << endl;
-          if (!starts_with(cstr+i,"DSYS")) throw std::runtime_error(
-            "missing DSYS in bin line");
-          const auto eq  = line.find('=',i);
-          const auto col = line.find(':',eq+1);
-          auto end = line.find(',',col+1);
-          if (end==std::string::npos) end = line.find(')',col+1);
-          const size_t sep = std::find(cstr+eq+1,cstr+col,',')-cstr;
-
-          const auto unc = line.substr(col+1,end-col-1);
-          if (!b.unc.emplace(
-            unc,
-            sep==col // one value
-            ? std::stod(line.substr(eq+1,col-eq-1))
-            : std::max( std::abs(std::stod(line.substr(eq +1,sep-eq -1))),
-                        std::abs(std::stod(line.substr(sep+1,col-sep-1))) )
-          ).second) throw std::runtime_error(cat(
-            "duplicate uncert source \'",unc,"\' on line ",line_n));
-
-          i = end+1;
-        }
-
-      } else it = vars.end();
-    }
-  }}
-
   // flip Dphi_yy_jj
   /*
   try {
-    auto& var = vars.at("Dphi_yy_jj_30");
+    auto& var = data.vars.at("Dphi_yy_jj_30").bins;
     std::swap(var[0],var[2]);
     for (auto& bin : var)
       std::tie(bin.min,bin.max) = std::forward_as_tuple(
@@ -212,48 +125,256 @@ int main(int argc, char* argv[]) {
   // ================================================================
 
   if (sig_fid_SM_file_name) {
-    std::unordered_map<
-      std::string,
-      std::vector<double>
-    > sig_fid_SM;
-
-    std::ifstream f(sig_fid_SM_file_name);
-    for (std::string line; std::getline(f,line); ) {
-      std::istringstream ss(std::move(line));
-      std::string var;
-      ss >> var;
-      auto& xs = sig_fid_SM[var];
-      for (double x; ss >> x; ) xs.push_back(x);
+    try {
+      profile::timer timer("SM");
+      hepdata::read_xsec(data,sig_fid_SM_file_name);
+    } catch (const std::exception& e) {
+      cerr <<"\033[31m"<< e.what() <<"\033[0m"<< endl;
+      return 1;
     }
+  }
 
-    // for (const auto& x : sig_fid_SM)
-    //   cout << x.first << endl;
+  return 0;
+}
 
-    // std::vector<std::pair< const std::string*, bool >> cnts;
-    // cnts.reserve(vars.size());
-    // for (const auto& v : vars) cnts.emplace_back(&v.first,false);
+// Prepared inputs, kept in memory by the daemon between requests
+// An entry is used for as long as sizes and modification times of its
+// HepData and --SM files don't change
+// At most max_entries are kept, dropping the least recently used
+class data_memory {
+  struct entry {
+    std::string stamp;
+    hepdata::data_t data;
+    uint64_t used;
+  };
+  std::map<std::string,entry> entries; // by real paths
+  uint64_t clock = 0;
+  static constexpr unsigned max_entries = 4;
 
-    for (auto& v : vars) {
-      try {
-        const auto& xs1 = sig_fid_SM.at(v.first);
-        auto& xs0 = v.second;
-        const auto n = xs0.size();
+  static std::string stamp(const char* name, std::string& path) {
+    if (!name) return { };
+    struct stat st;
+    char* p = ::realpath(name,nullptr);
+    if (!p) return { };
+    path += p;
+    std::free(p);
+    if (::stat(path.c_str(),&st)) return { };
+#ifdef __APPLE__
+    const auto& t = st.st_mtimespec;
+#else
+    const auto& t = st.st_mtim;
+#endif
+    return cat(st.st_size,':',t.tv_sec,':',t.tv_nsec,';');
+  }
+  static std::string stamp(
+    const char* file, const char* sm, std::string& key
+  ) {
+    key.clear();
+    auto s = stamp(file,key);
+    key += '\n';
+    return s + stamp(sm,key);
+  }
 
-        if (xs1.size() != n) {
-          cerr << "Unequal binning in sig_fid_SM for " << v.first << endl;
-          return 1;
-        }
+public:
+  hepdata::data_t* get(const char* file, const char* sm) {
+    std::string key;
+    const auto s = stamp(file,sm,key);
+    const auto it = entries.find(key);
+    if (it==entries.end()) return nullptr;
+    if (it->second.stamp!=s) { // files changed
+      entries.erase(it);
+      return nullptr;
+    }
+    it->second.used = ++clock;
+    return &it->second.data;
+  }
+  hepdata::data_t& put(
+    const char* file, const char* sm, hepdata::data_t&& data
+  ) {
+    std::string key;
+    auto s = stamp(file,sm,key);
+    auto& e = entries[key];
+    e.stamp = std::move(s);
+    e.data = std::move(data);
+    e.used = ++clock;
+    while (entries.size() > max_entries)
+      entries.erase(std::min_element(entries.begin(),entries.end(),
+        [](const auto& a, const auto& b){
+          return a.second.used < b.second.used;
+        }));
+    return e.data;
+  }
+};
 
-        for (unsigned i=0; i<n; ++i)
-          xs0[i].xsec = xs1[i];
+// Draw plots for one command line
+// With memory, parsed inputs are reused between calls
+int run(int argc, char* argv[], data_memory* memory) {
+  const char *data_file_name, *sig_fid_SM_file_name = nullptr,
+             *trace_file_name = nullptr, *grid_arg = nullptr,
+             *groups_file_name = nullptr;
+  bool burst = false, corr_arg = false, no_cache = false, rebuild_cache = false,
+       incremental = false, compact = false, prof = false, async = false,
+       skip_unchanged = false, corr_global = false, correlation = false;
+  unsigned nthreads = 1, njobs = 1, corr_n = 4;
+  unsigned long ntoys = 0;
+  uint64_t seed = 1;
+  std::vector<const char*> view_names, uncorr_args;
+  boost::optional<std::unordered_map<std::string,double>> ranges_map;
+  hepdata::data_t local_data;
 
-      } catch(const std::out_of_range& e) {
-        cerr << "No sig_fid_SM value for variable " << v.first << endl;
-        return 1;
-      }
+  try {
+    using namespace ivanp::po;
+    if (program_options()
+      (data_file_name,'f',"",req(),pos(1))
+      (sig_fid_SM_file_name,"--SM","divide by σfidSM",pos(1))
+      (burst,"burst","")
+      (corr_arg,"corr","")
+      (corr_n,"--corr-n","with corr, draw N largest sources (default: 4)")
+      (corr_global,"--corr-global",
+       "with corr, select sources by all variables together")
+      (view_names,"--views","draw several views: standard, corr",multi())
+      (ranges_map,{"-r","--range"},"",read_to_map{})
+      (groups_file_name,{"-g","--groups"},"file with groups of sources")
+      (correlation,"--correlation",
+       "draw correlation maps of bins in correlation.pdf")
+      (ntoys,"--toys","standard bands from N pseudo-experiments")
+      (seed,"--seed","with --toys, random seed (default: 1)")
+      (uncorr_args,"--uncorr",
+       "sources uncorrelated between bins (default: bkg_model_uncorr)",
+       multi())
+      (nthreads,{"-t","--threads"},
+       "parse datasets, sum covariance and run toys on N threads (0 = all)")
+      (no_cache,"--no-cache","don't use binary cache of parsed input")
+      (rebuild_cache,"--rebuild-cache","reparse input and rewrite cache")
+      (incremental,{"-i","--incremental"},
+       "only redraw plots with changed inputs")
+      (njobs,{"-j","--jobs"},"with burst, draw in N processes (0 = all)")
+      (compact,"--compact","draw each band as a single polygon")
+      (async,"--async","write PDFs in another process while drawing")
+      (skip_unchanged,"--skip-unchanged",
+       "don't rewrite files if the plots would be the same")
+      (grid_arg,"--grid","without burst, draw RxC plots per page, e.g. 2x3")
+      (prof,"--profile","print time spent in each phase, and counters")
+      (trace_file_name,"--trace","write --profile as Chrome trace to file")
+      .parse(argc,argv,true)) return 0;
+  } catch (const std::exception& e) {
+    cerr <<"\033[31m"<< e.what() <<"\033[0m"<< endl;
+    return 1;
+  }
+  auto& profiler = profile::get();
+  profiler.enable(prof || trace_file_name);
+  // sizes of written files
+  auto count_output = [&](const std::string& name){
+    if (!profiler.enabled()) return;
+    struct stat st;
+    if (::stat(name.c_str(),&st)) return;
+    profile::count("files written",1);
+    profile::count("output bytes",st.st_size);
+  };
+
+  unsigned grid_rows = 0, grid_cols = 0;
+  if (grid_arg) {
+    char c;
+    if (std::sscanf(grid_arg,"%ux%u%c",&grid_rows,&grid_cols,&c)!=2
+        || !grid_rows || !grid_cols) {
+      cerr << "\033[31mBad --grid: " << grid_arg
+           << ", expected rows x columns, e.g. 2x3\033[0m" << endl;
+      return 1;
+    }
+    if (burst) {
+      cerr << "\033[33m--grid is ignored with burst\033[0m" << endl;
+      grid_rows = grid_cols = 0;
     }
   }
 
+  std::vector<bool> views; // corr or not
+  for (const char* name : view_names) {
+    if (!strcmp(name,"standard")) views.push_back(false);
+    else if (!strcmp(name,"corr")) views.push_back(true);
+    else {
+      cerr << "\033[31mUnknown view: " << name << "\033[0m" << endl;
+      return 1;
+    }
+  }
+  // corr on its own, or together with --views
+  if (views.empty() || (corr_arg &&
+      std::find(views.begin(),views.end(),true)==views.end()))
+    views.push_back(corr_arg);
+
+  hepdata::data_t* data_ptr = memory && !rebuild_cache
+    ? memory->get(data_file_name,sig_fid_SM_file_name) : nullptr;
+  if (!data_ptr) {
+    hepdata::data_t data;
+    if (const int status = prepare(data,data_file_name,sig_fid_SM_file_name,
+        nthreads,
+        no_cache ? hepdata::cache_mode::off :
+        rebuild_cache ? hepdata::cache_mode::rebuild :
+        hepdata::cache_mode::use)) return status;
+    data_ptr = memory
+      ? &memory->put(data_file_name,sig_fid_SM_file_name,std::move(data))
+      : &(local_data = std::move(data));
+  }
+  const auto& data = *data_ptr;
+  const auto& vars = data.vars;
+  const auto& sources = data.sources;
+
+  // bands of the standard view
+  hepdata::groups_t groups;
+  try {
+    groups = groups_file_name ? hepdata::read_groups(groups_file_name)
+                              : hepdata::default_groups();
+  } catch (const std::exception& e) {
+    cerr <<"\033[31m"<< e.what() <<"\033[0m"<< endl;
+    return 1;
+  }
+  groups.compile(sources);
+  uint64_t groups_hash;
+  { hasher h;
+    for (const auto& g : groups) {
+      h(g.name)(g.label)(g.fill)(g.line)(g.style);
+      for (const auto& p : g.patterns) h(p);
+    }
+    groups_hash = h.value();
+  }
+  const auto styles = [&]{
+    std::vector<std::array<int,3>> v;
+    for (const auto& g : groups) v.push_back({{g.fill,g.line,g.style}});
+    return v;
+  }();
+  const auto labels = [&]{
+    std::vector<std::string> v;
+    for (const auto& g : groups) v.push_back(g.label);
+    return v;
+  }();
+  // sources drawn separately in the corr view
+  hepdata::corr_t corr_sel;
+  corr_sel.n = corr_n;
+  if (corr_global && std::find(views.begin(),views.end(),true)!=views.end())
+    corr_sel.sources = hepdata::rank_sources(data,corr_n);
+
+  std::vector<std::string> uncorr(uncorr_args.begin(),uncorr_args.end());
+  if (uncorr.empty()) uncorr = { "bkg_model_uncorr" };
+  // standard bands from pseudo-experiments
+  std::map<std::string,hepdata::toy_result_t> toys;
+  if (ntoys && std::find(views.begin(),views.end(),false)!=views.end()) try {
+    hepdata::toys_config conf;
+    conf.ntoys = ntoys;
+    conf.seed = seed;
+    conf.nthreads = nthreads;
+    conf.uncorr = uncorr;
+    toys = hepdata::run_toys(data,groups,conf);
+  } catch (const std::exception& e) {
+    cerr <<"\033[31m"<< e.what() <<"\033[0m"<< endl;
+    return 1;
+  }
+
+  auto make_bands = [&](const auto& var, bool corr, std::ostream* log){
+    return corr
+      ? hepdata::make_bands(data,var.first,var.second,corr_sel,log)
+      : !toys.empty() ? toys.at(var.first).bands()
+      : hepdata::make_bands(data,var.first,var.second,groups);
+  };
+
   // ================================================================
 
   static const std::unordered_map<std::string,std::string> tex {
@@ -282,260 +403,682 @@ int main(int argc, char* argv[]) {
     {"fid_lep1", "#it{N}_{lept} #geq 1"}
   };
 
-  TCanvas canv;
-  canv.SetBottomMargin(0.13);
-  canv.SetRightMargin(0.035);
-  canv.SetTopMargin(0.03);
-  canv.SetLeftMargin(corr ? 0.12 : 0.1);
-  if (!burst) canv.SaveAs(cat("uncert",corr  ? "_corr" : "",".pdf[").c_str());
-
-  gPad->SetTickx();
-  gPad->SetTicky();
-
-  for (const auto& var : vars) {
-    cout << var.first << endl;
-
-    // canv.SetLogx(var.first == "Dphi_yy_jj_30");
-
-    std::vector<const std::string*> corr_selected, corr_other;
-    if (corr) { // select most significant contributions
-      std::vector<std::pair<const std::string*,std::vector<double>>> corr_uncs;
-      for (const auto& bin : var.second) {
-        for (const auto& unc : bin.unc) {
-          const auto& name = unc.first;
-          if (name=="lumi" ||
-              name=="fit"  ||
-              name=="bkg_model_uncorr") continue;
-          auto it = std::find_if(corr_uncs.begin(),corr_uncs.end(),
-            [&name](const auto& x){ return name == *x.first; });
-          if (it==corr_uncs.end()) {
-            corr_uncs.emplace_back(&name,decltype(it->second){});
-            it = --corr_uncs.end();
+  // ================================================================
+
+  // range of the y axis
+  auto plot_range = [&](const std::string& name,
+                        const std::vector<std::vector<double>>& tuncs){
+    const auto max = *std::max_element(tuncs.back().begin(),tuncs.back().end());
+    auto range = std::exp2( std::ceil( std::log2(max) ) );
+    if (range > 8) range = 8;
+    else if (max/range > 0.7) range *= 2;
+
+    if (ranges_map) {
+      try { range = ranges_map->at(name); } catch (...) { }
+    }
+    return range;
+  };
+
+  // each view is drawn from the same parsed data
+  int status = 0;
+  hist_pool pool; // histograms reused between variables
+  for (const bool corr : views) {
+    // Hashes of everything that goes into each plot
+    // Increase plot_version when changing how plots are drawn
+    constexpr unsigned plot_version = 1;
+    std::unique_ptr<manifest> outputs;
+    std::vector<uint64_t> var_hashes;
+    if (incremental) {
+      outputs.reset(new manifest("plot.manifest"));
+      var_hashes.reserve(vars.size());
+      for (const auto& var : vars) {
+        hasher h;
+        h(plot_version)(corr)(compact)(var.first)(var.second.bins);
+        if (grid_rows) h(grid_rows)(grid_cols);
+        if (!corr) {
+          h(groups_hash);
+          if (ntoys) {
+            h(ntoys)(seed);
+            for (const auto& name : uncorr) h(name);
           }
-          it->second.push_back(unc.second/bin.xsec);
+        } else {
+          h(corr_n)(corr_global);
+          // with --corr-global, selected by the other variables too
+          for (unsigned id : corr_sel.sources)
+            if (var.second.find(id) >= 0) h(sources[id]);
+        }
+        for (unsigned c=0; c<var.second.ncols(); ++c) {
+          const unsigned nbins = var.second.nbins();
+          h(sources[var.second.src[c]])
+           (var.second.col(c),nbins*sizeof(double))
+           (var.second.col_has(c),nbins);
+          // toys also depend on signs and asymmetry of shifts
+          if (ntoys && !corr)
+            h(var.second.col_shift(c),nbins*sizeof(double))
+             (var.second.col_mid(c),nbins*sizeof(double));
+        }
+        if (ranges_map) {
+          const auto it = ranges_map->find(var.first);
+          if (it!=ranges_map->end()) h(it->second);
         }
+        var_hashes.push_back(h.value());
       }
-      auto corr_uncs_sorted = corr_uncs | [](const auto& x){
-        // sum squares of relative unc in each bin
-        return std::make_pair(x.first,
-          std::accumulate(x.second.begin(),x.second.end(),0.,
-            [](auto total, auto next){ return total + sq(next); }));
-      };
-      std::sort(corr_uncs_sorted.begin(),corr_uncs_sorted.end(),
-        [](const auto& a, const auto& b){ return a.second > b.second; });
-
-      const unsigned n = std::min(4u,(unsigned)corr_uncs_sorted.size());
-      corr_selected.reserve(n);
-      for (unsigned i=n; i; )
-        --i, corr_selected.emplace_back(corr_uncs_sorted[i].first);
-      if (corr_uncs_sorted.size()>n) {
-        corr_other.reserve(corr_uncs_sorted.size()-n);
-        for (unsigned i=n; i<corr_uncs_sorted.size(); ++i)
-          corr_other.emplace_back(corr_uncs_sorted[i].first);
+      if (!burst) { // single file with all variables
+        const auto name = cat("uncert",corr ? "_corr" : "",".pdf");
+        const auto hash = hash64(var_hashes.data(),
+          var_hashes.size()*sizeof(uint64_t));
+        if (!outputs->changed(name,hash)) {
+          cout << name << " is up to date" << endl;
+          continue;
+        }
+        outputs->set(name,hash);
       }
+    }
 
-      // for (const auto* x : corr_selected)
-      //   cout <<"  "<< *x << endl;
+    // variables to draw
+    std::vector<const std::pair<const std::string,hepdata::var_t>*> todo;
+    std::vector<std::pair<std::string,uint64_t>> todo_hashes;
+    { unsigned var_i = 0;
+      for (const auto& var : vars) {
+        if (burst && outputs) {
+          auto name = cat(var.first,corr ? "_corr" : "",".pdf");
+          const auto hash = var_hashes[var_i++];
+          if (!outputs->changed(name,hash)) continue;
+          todo_hashes.emplace_back(std::move(name),hash);
+        }
+        todo.push_back(&var);
+      }
     }
 
-    // collect bin edges
-    const auto edges = ( var.second | [](const auto& b){ return b.min; } )
-                     << var.second.back().max;
-
-    // collect uncertainties
-    auto uncs = var.second | [&](const auto& b){
-      if (!corr) {
-        return std::vector<double> {
-          at(b.unc,"lumi",__LINE__),
-          [&b]{
-            double x = 0;
-            for (const auto& unc : b.unc) {
-              if (unc.first=="lumi" ||
-                  unc.first=="fit"  ||
-                  unc.first=="bkg_model_uncorr") continue;
-              x += sq(unc.second);
-            }
-            return std::sqrt(x);
-          }(),
-          qadd(at(b.unc,"fit",__LINE__),
-               at(b.unc,"bkg_model_uncorr",__LINE__)),
-          b.stat
-        };
+    // Skip files that would be drawn the same as they are
+    // Fingerprints of what is drawn are kept in FILE.fingerprint
+    // Styles and labels are determined by the variable name, corr,
+    // the names of the selected sources or the groups, and plot_version
+    std::vector<uint64_t> fingerprints;
+    auto fingerprint = [&](const auto& var){
+      const auto b = make_bands(var,corr,nullptr);
+      hasher h;
+      h(plot_version)(corr)(compact)(var.first)(b.edges)
+       (plot_range(var.first,b.tuncs));
+      if (grid_rows) h(grid_rows)(grid_cols);
+      if (!corr) h(groups_hash);
+      for (const auto& unc : b.tuncs) h(unc);
+      for (unsigned c : b.corr_selected) h(sources[var.second.src[c]]);
+      return h.value();
+    };
+    auto save_fingerprint = [](const std::string& name, uint64_t hash){
+      manifest fp(name+".fingerprint");
+      fp.set(name,hash);
+      try {
+        fp.save();
+      } catch (const std::exception& e) {
+        cerr << "\033[33m" << e.what() << "\033[0m" << endl;
+      }
+    };
+    if (skip_unchanged && todo.size()) {
+      profile::timer timer("fingerprint");
+      if (burst) {
+        unsigned n = 0;
+        for (unsigned i=0; i<todo.size(); ++i) {
+          const auto name = cat(todo[i]->first,corr ? "_corr" : "",".pdf");
+          const auto hash = fingerprint(*todo[i]);
+          if (!manifest(name+".fingerprint").changed(name,hash)) {
+            if (outputs) outputs->set(todo_hashes[i].first,
+                                      todo_hashes[i].second);
+            continue;
+          }
+          todo[n] = todo[i];
+          if (outputs) todo_hashes[n] = std::move(todo_hashes[i]);
+          fingerprints.push_back(hash);
+          ++n;
+        }
+        todo.resize(n);
+        if (outputs) todo_hashes.resize(n);
       } else {
-        cout << b.min << endl;
-        return ( corr_selected | [&b](const auto& s){
-          const auto err = b.unc.at(*s);
-          cout <<"  "<< *s <<' '<< err << endl;
-          return err;
-        } ) << std::sqrt(std::accumulate(
-          corr_other.begin(),corr_other.end(),0.,
-          [&b](auto total, const auto* s){ return total + sq(b.unc.at(*s)); }
-        ));
+        hasher h;
+        for (const auto* var : todo) h(fingerprint(*var));
+        const auto name = cat("uncert",corr ? "_corr" : "",".pdf");
+        if (!manifest(name+".fingerprint").changed(name,h.value())) {
+          cout << name << " is unchanged" << endl;
+          if (outputs) try {
+            outputs->save();
+          } catch (const std::exception& e) {
+            cerr << "\033[33m" << e.what() << "\033[0m" << endl;
+          }
+          continue;
+        }
+        fingerprints.push_back(h.value());
+      }
+    }
+
+    // saves pages in another process, with --async
+    canvas_writer* writer = nullptr;
+    // If the writer fails, it is dropped and the remaining pages are saved
+    // here, but outputs are not recorded
+    bool writer_failed = false, doc_opened = false;
+    auto to_writer = [&](auto f){
+      try {
+        f();
+        return true;
+      } catch (const std::exception& e) {
+        cerr <<"\033[31m"<< e.what() <<"\033[0m"<< endl;
+        writer->finish();
+        writer = nullptr;
+        writer_failed = true;
+        status = 1;
+        return false;
       }
     };
 
-    // partial sums in quadrature
-    for (auto& unc : uncs)
-      for (unsigned i=1; i<unc.size(); ++i)
-        unc[i] = qadd(unc[i],unc[i-1]);
+    // objects drawn on a pad, kept until its page is saved
+    struct drawn_t {
+      std::vector<std::array<h_ptr,3>> bands;
+      std::vector<std::unique_ptr<TGraph>> polygons;
+      std::unique_ptr<TLegend> leg;
+    };
+
+    // draw plot of one variable on the current pad
+    auto draw_pad = [&](const auto& var, drawn_t& drawn){
+      cout << var.first << endl;
+
+      // canv.SetLogx(var.first == "Dphi_yy_jj_30");
+
+      profile::timer bands_timer("bands",var.first);
+      const auto bands_data = make_bands(var,corr,&cout);
+      bands_timer.stop();
+      profile::timer draw_timer("draw",var.first);
+      const auto& edges = bands_data.edges;
+      const auto& tuncs = bands_data.tuncs;
+      const auto& corr_selected = bands_data.corr_selected;
 
-    // divide by cross section
-    tie(uncs,var.second) * [](auto& unc, const auto& b){
-      for (auto& u : unc) {
-        // TEST(u)
-        u /= b.xsec;
+      static const std::vector<std::array<int,3>> styles_corr {
+        {{kOrange+9,1,1}},
+        {{kOrange+3,1,2}},
+        {{kOrange+8,1,1}},
+        {{kOrange-2,1,2}},
+        {{kOrange-9,1,1}}
+      };
+
+      // selected sources cycle through the first 4 styles
+      const auto corr_styles = [&]{
+        std::vector<std::array<int,3>> v;
+        for (unsigned i=0; i+1<tuncs.size(); ++i) v.push_back(styles_corr[i%4]);
+        v.push_back(styles_corr.back()); // others
+        return v;
+      };
+
+      auto& bands = drawn.bands;
+      bands = tie(tuncs, corr ? corr_styles() : styles) *
+        [&](const auto& unc, const auto& style){
+          auto band = make_band(edges, unc, &pool);
+          band->SetFillColor(get<0>(style));
+          band->SetLineColor(get<1>(style));
+          band->SetLineStyle(get<2>(style));
+          if (compact) return std::array<h_ptr,3> { std::move(band) };
+          auto outline = make_outline(band.get(), &pool);
+          return std::array<h_ptr,3> {
+            std::move(band),
+            std::move(get<0>(outline)),
+            std::move(get<1>(outline))
+          };
+        };
+
+      const auto& total = bands.back();
+      get<0>(total)->SetTitle("");
+      TAxis *xa = get<0>(total)->GetXaxis(),
+            *ya = get<0>(total)->GetYaxis();
+      xa->SetTitle(at(tex,var.first,__LINE__).c_str());
+      xa->SetTitleOffset(0.95);
+      ya->SetTitleOffset(corr ? 0.9 : 0.7);
+      ya->SetTitle("#it{#Deltacf}/#it{cf}");
+      // ya->SetTitle(("#it{#Delta#sigma}_{fid} / #it{#sigma}_{fid}"s
+      //   + (sig_fid_SM_file_name ? "^{SM}" : "")).c_str());
+      xa->SetTitleSize(0.06);
+      xa->SetLabelSize(0.05);
+      ya->SetTitleSize(0.065);
+      ya->SetLabelSize(0.05);
+
+      const auto range = plot_range(var.first,tuncs);
+      ya->SetRangeUser(-range,range);
+      auto& polygons = drawn.polygons;
+      if (compact) {
+        get<0>(total)->Draw("AXIS");
+        // draw in oposite order, so that smaller values can be seen
+        for (unsigned i=bands.size(); i; ) {
+          polygons.push_back(make_polygon(get<0>(bands[--i]).get()));
+          polygons.back()->Draw("LF");
+        }
+      } else {
+        get<0>(total)->Draw("E2");
+
+        get<1>(total)->Draw("same");
+        get<2>(total)->Draw("same");
+      }
+
+      if (starts_with(var.first,"N_j_")) {
+        for (unsigned i=0, n=edges.size()-1; i<n; ++i) {
+          xa->SetBinLabel( i+1, cat(
+            n-i>1 ? " = " : " #geq ", std::ceil(edges[i])
+          ).c_str() );
+        }
+        xa->SetLabelSize(0.08);
+      } else if (var.first.substr(0,4)=="fid_") {
+        xa->SetBinLabel(1,"");
       }
-    };
 
-    // for (auto& unc : uncs) {
-    //   for (auto& u : unc) cout << u << ' ';
-    //   cout << '\n';
-    // }
+      // draw in oposite order, so that smaller values can be seen
+      if (!compact) for (unsigned i=bands.size()-1; i; ) {
+        --i;
+        for (unsigned j=0, n=bands[i].size(); j<n; ++j)
+          bands[i][j]->Draw("E2same" + (j ? 2 : 0));
+      }
 
-    std::vector<std::vector<double>> tuncs(uncs.front().size());
-    for (unsigned i=0; i<uncs.front().size(); ++i) {
-      tuncs[i].resize(uncs.size());
-      for (unsigned j=0; j<uncs.size(); ++j)
-        tuncs[i][j] = uncs[j][i];
-    }
+      gPad->RedrawAxis();
 
-    static const std::vector<std::array<int,3>> styles {
-      {{kAzure-6,1,1}},
-      {{kAzure+8,1,3}},
-      {{kAzure-8,1,2}},
-      {{17,1,1}}
+      static const auto corr_labels = make_default_map<std::string>({
+        { "jes_pu_rho", "Jet pileup suppression" },
+        { "gen_model", "Theoretical modelling" },
+        { "jes_flav_comp", "Jet flavour dependence" },
+        { "JER", "Jet energy resolution" },
+        { "iso", "Isolation" },
+        { "pileup", "Pileup" },
+        { "trig", "Trigger" },
+        { "PID", "Photon identification" },
+        { "prw", "Pileup modelling" },
+        { "PES", "Photon energy scale" }
+      });
+
+      drawn.leg.reset(new TLegend(
+        0.14, 0.165,
+        // corr ? 0.165 : 0.1525,
+        corr ? 0.92  : 0.72,
+        corr ? 0.285 : 0.265
+      ));
+      auto& leg = *drawn.leg;
+      leg.SetLineWidth(0);
+      leg.SetFillColor(0);
+      leg.SetFillStyle(0);
+      leg.SetTextSize(0.041);
+      leg.SetNColumns(2);
+      tie(bands,
+          !corr ? labels : (corr_selected | [&,i=0](unsigned c) mutable {
+            return cat(i++ ? "#oplus " : "",
+                       corr_labels[sources[var.second.src[c]]]);
+          }) << "#oplus Others"
+        ) * [&leg](const auto& band, const std::string& lbl){
+          leg.AddEntry(get<0>(band).get(),lbl.c_str(),"f");
+        };
+      leg.Draw();
+
+      TLatex l;
+      l.SetTextColor(1);
+      l.SetNDC();
+      l.SetTextFont(72);
+      l.DrawLatex(0.15,0.83,"ATLAS");
+      l.SetTextFont(42);
+      l.DrawLatex(0.27,0.83,"Internal");
+      // l.DrawLatex(0.255,0.83,"Preliminary");
+      l.SetTextFont(42);
+      l.DrawLatex(0.15,0.89,
+        "#it{H} #rightarrow #gamma#gamma, "
+        "#sqrt{#it{s}} = 13 TeV, 36.1 fb^{-1}, "
+        "m_{H} = 125.09 GeV"
+      );
+      l.SetTextFont(42);
     };
-    static const std::vector<std::array<int,3>> styles_corr {
-      {{kOrange+9,1,1}},
-      {{kOrange+3,1,2}},
-      {{kOrange+8,1,1}},
-      {{kOrange-2,1,2}},
-      {{kOrange-9,1,1}}
+
+    auto save_page = [&](TCanvas& canv, const std::string& name,
+                         const std::string& arg){
+      profile::timer save_timer(writer ? "send" : "SaveAs",arg);
+      if (writer && to_writer([&]{ writer->save(canv,name); })) return;
+      if (!burst && !doc_opened) { // after the writer failed
+        canv.SaveAs((name+'[').c_str());
+        doc_opened = true;
+      }
+      canv.SaveAs(name.c_str());
     };
 
-    const auto bands = tie(tuncs, corr ? styles_corr : styles) *
-      [&edges](const auto& unc, const auto& style){
-        auto band = make_band(edges, unc);
-        band->SetFillColor(get<0>(style));
-        band->SetLineColor(get<1>(style));
-        band->SetLineStyle(get<2>(style));
-        auto outline = make_outline(band.get());
-        return std::array<h_ptr,3> {
-          std::move(band),
-          std::move(get<0>(outline)),
-          std::move(get<1>(outline))
-        };
-      };
+    auto draw = [&](const auto& var, TCanvas& canv){
+      drawn_t drawn;
+      draw_pad(var,drawn);
+      const auto name = cat(
+        burst ? var.first : "uncert",
+        corr  ? "_corr" : "",
+        ".pdf");
+      save_page(canv,name,var.first);
+      if (burst && !writer) count_output(name);
+    };
 
-    const auto& total = bands.back();
-    get<0>(total)->SetTitle("");
-    TAxis *xa = get<0>(total)->GetXaxis(),
-          *ya = get<0>(total)->GetYaxis();
-    xa->SetTitle(at(tex,var.first,__LINE__).c_str());
-    xa->SetTitleOffset(0.95);
-    ya->SetTitleOffset(corr ? 0.9 : 0.7);
-    ya->SetTitle("#it{#Deltacf}/#it{cf}");
-    // ya->SetTitle(("#it{#Delta#sigma}_{fid} / #it{#sigma}_{fid}"s
-    //   + (sig_fid_SM_file_name ? "^{SM}" : "")).c_str());
-    xa->SetTitleSize(0.06);
-    xa->SetLabelSize(0.05);
-    ya->SetTitleSize(0.065);
-    ya->SetLabelSize(0.05);
+    auto setup_canvas = [&](TVirtualPad& canv){
+      canv.SetBottomMargin(0.13);
+      canv.SetRightMargin(0.035);
+      canv.SetTopMargin(0.03);
+      canv.SetLeftMargin(corr ? 0.12 : 0.1);
+    };
 
-    const auto max = *std::max_element(tuncs.back().begin(),tuncs.back().end());
-    auto range = std::exp2( std::ceil( std::log2(max) ) );
-    if (range > 8) range = 8;
-    else if (max/range > 0.7) range *= 2;
+    if (burst && njobs!=1 && todo.size()>1) {
+      // draw in forked processes, each with its own canvas
+      if (njobs==0) njobs = std::thread::hardware_concurrency();
+      std::unique_ptr<TCanvas> canv;
+      std::vector<unsigned char> done;
+      unsigned failed;
+      try {
+        profile::timer timer("fork pool");
+        failed = fork_pool(todo.size(),njobs,[&](unsigned i){
+          if (!canv) {
+            canv.reset(new TCanvas());
+            setup_canvas(*canv);
+            gPad->SetTickx();
+            gPad->SetTicky();
+          }
+          draw(*todo[i],*canv);
+        },done);
+      } catch (const std::exception& e) {
+        cerr <<"\033[31m"<< e.what() <<"\033[0m"<< endl;
+        status = 1;
+        continue;
+      }
+      for (unsigned i=0; i<todo.size(); ++i) {
+        if (!done[i]) continue;
+        const auto name = cat(todo[i]->first,corr ? "_corr" : "",".pdf");
+        count_output(name);
+        if (skip_unchanged) save_fingerprint(name,fingerprints[i]);
+      }
+      if (outputs) {
+        for (unsigned i=0; i<todo.size(); ++i)
+          if (done[i]) outputs->set(todo_hashes[i].first,todo_hashes[i].second);
+        try {
+          outputs->save();
+        } catch (const std::exception& e) {
+          cerr << "\033[33m" << e.what() << "\033[0m" << endl;
+        }
+      }
+      if (failed) status = 1;
+      continue;
+    }
 
-    if (ranges_map) {
-      try { range = ranges_map->at(var.first); } catch (...) { }
+    // the writer is forked before the canvas is made
+    std::unique_ptr<canvas_writer> async_writer;
+    if (async && todo.size()) {
+      try {
+        async_writer.reset(new canvas_writer());
+        writer = async_writer.get();
+      } catch (const std::exception& e) {
+        cerr << "\033[33m" << e.what() << "\033[0m" << endl;
+      }
     }
 
-    ya->SetRangeUser(-range,range);
-    get<0>(total)->Draw("E2");
+    TCanvas canv;
+    setup_canvas(canv);
+    const auto doc_name = cat("uncert",corr  ? "_corr" : "",".pdf");
+    if (!burst) {
+      if (!(writer && to_writer([&]{ writer->open(doc_name); }))) {
+        canv.SaveAs((doc_name+'[').c_str());
+        doc_opened = true;
+      }
+    }
 
-    get<1>(total)->Draw("same");
-    get<2>(total)->Draw("same");
+    gPad->SetTickx();
+    gPad->SetTicky();
 
-    if (starts_with(var.first,"N_j_")) {
-      for (unsigned i=0, n=edges.size()-1; i<n; ++i) {
-        xa->SetBinLabel( i+1, cat(
-          n-i>1 ? " = " : " #geq ", std::ceil(edges[i])
-        ).c_str() );
+    if (grid_rows) { // several variables per page
+      canv.Divide(grid_cols,grid_rows);
+      const unsigned npads = grid_rows*grid_cols;
+      std::vector<drawn_t> drawn(npads);
+      for (unsigned i=0; i<todo.size(); i+=npads) {
+        for (unsigned j=0; j<npads; ++j) {
+          TVirtualPad* pad = canv.cd(j+1);
+          drawn[j] = drawn_t(); // objects of the previous page
+          if (i+j < todo.size()) {
+            setup_canvas(*pad);
+            pad->SetTickx();
+            pad->SetTicky();
+            draw_pad(*todo[i+j],drawn[j]);
+          } else pad->Clear();
+        }
+        save_page(canv,doc_name,"");
+      }
+      canv.cd();
+    } else for (const auto* var : todo) draw(*var,canv);
+    if (!burst) {
+      profile::timer timer(writer ? "send" : "SaveAs");
+      if (!(writer && to_writer([&]{ writer->close(doc_name); }))
+          && doc_opened)
+        canv.SaveAs((doc_name+']').c_str());
+    }
+    if (writer) {
+      profile::timer timer("wait writer");
+      const bool ok = writer->finish();
+      writer = nullptr;
+      if (!ok) {
+        cerr << "\033[31mfailed to write " << (burst ? "plots" : doc_name)
+             << "\033[0m" << endl;
+        status = 1;
+        continue; // don't record outputs in the manifest
+      }
+    }
+    if (writer_failed) continue; // also here
+    if (!burst) {
+      count_output(doc_name);
+      // no fingerprint without variables to draw
+      if (skip_unchanged && !fingerprints.empty())
+        save_fingerprint(doc_name,fingerprints[0]);
+    } else if (async_writer || skip_unchanged) {
+      for (unsigned i=0; i<todo.size(); ++i) {
+        const auto name = cat(todo[i]->first,corr ? "_corr" : "",".pdf");
+        if (async_writer) count_output(name);
+        if (skip_unchanged) save_fingerprint(name,fingerprints[i]);
       }
-      xa->SetLabelSize(0.08);
-    } else if (var.first.substr(0,4)=="fid_") {
-      xa->SetBinLabel(1,"");
     }
 
-    // draw in oposite order, so that smaller values can be seen
-    for (unsigned i=bands.size()-1; i; ) {
-      --i;
-      for (unsigned j=0, n=bands[i].size(); j<n; ++j)
-        bands[i][j]->Draw("E2same" + (j ? 2 : 0));
+    if (outputs) {
+      for (const auto& h : todo_hashes) outputs->set(h.first,h.second);
+      try {
+        outputs->save();
+      } catch (const std::exception& e) {
+        cerr << "\033[33m" << e.what() << "\033[0m" << endl;
+      }
     }
+  }
+
+  // Correlation maps of bins of all variables together, then of each variable
+  if (correlation) try {
+    const auto cov = hepdata::covariance(data,{},uncorr,nthreads);
+    profile::timer timer("correlation");
 
-    gPad->RedrawAxis();
+    gStyle->SetPalette(kLightTemperature);
+    TCanvas canv;
+    canv.SetBottomMargin(0.13);
+    canv.SetLeftMargin(0.13);
+    canv.SetRightMargin(0.13);
+    canv.SetTopMargin(0.05);
+    const std::string name = "correlation.pdf";
+    canv.SaveAs((name+'[').c_str());
 
-    static const std::vector<std::string> labels {
-      "Luminosity",
-      "#oplus Correction factor",
-      "#oplus Signal extraction",
-      "#oplus Statistics"
+    auto draw_map = [&](TH2D& h, unsigned first, unsigned n){
+      for (unsigned i=0; i<n; ++i)
+        for (unsigned j=0; j<n; ++j)
+          h.SetBinContent(i+1,j+1,cov.corr(first+i,first+j));
+      h.SetStats(false);
+      h.SetMinimum(-1);
+      h.SetMaximum(1);
+      h.SetContour(100);
+      h.Draw("COLZ");
+      canv.SaveAs(name.c_str());
     };
-    static const auto corr_labels = make_default_map<std::string>({
-      { "jes_pu_rho", "Jet pileup suppression" },
-      { "gen_model", "Theoretical modelling" },
-      { "jes_flav_comp", "Jet flavour dependence" },
-      { "JER", "Jet energy resolution" },
-      { "iso", "Isolation" },
-      { "pileup", "Pileup" },
-      { "trig", "Trigger" },
-      { "PID", "Photon identification" },
-      { "prw", "Pileup modelling" },
-      { "PES", "Photon energy scale" }
-    });
-
-    TLegend leg(
-      0.14, 0.165,
-      // corr ? 0.165 : 0.1525,
-      corr ? 0.92  : 0.72,
-      corr ? 0.285 : 0.265
-    );
-    leg.SetLineWidth(0);
-    leg.SetFillColor(0);
-    leg.SetFillStyle(0);
-    leg.SetTextSize(0.041);
-    leg.SetNColumns(2);
-    tie(bands,
-        !corr ? labels : (corr_selected | [i=0](auto* s) mutable {
-          return cat(i++ ? "#oplus " : "",corr_labels[*s]);
-        }) << "#oplus Others"
-      ) * [&leg](const auto& band, const std::string& lbl){
-        leg.AddEntry(get<0>(band).get(),lbl.c_str(),"f");
-      };
-    leg.Draw();
-
-    TLatex l;
-    l.SetTextColor(1);
-    l.SetNDC();
-    l.SetTextFont(72);
-    l.DrawLatex(0.15,0.83,"ATLAS");
-    l.SetTextFont(42);
-    l.DrawLatex(0.27,0.83,"Internal");
-    // l.DrawLatex(0.255,0.83,"Preliminary");
-    l.SetTextFont(42);
-    l.DrawLatex(0.15,0.89,
-      "#it{H} #rightarrow #gamma#gamma, "
-      "#sqrt{#it{s}} = 13 TeV, 36.1 fb^{-1}, "
-      "m_{H} = 125.09 GeV"
-    );
-    l.SetTextFont(42);
-
-    canv.SaveAs(cat(
-      burst ? var.first : "uncert",
-      corr  ? "_corr" : "",
-      ".pdf").c_str());
+
+    { const unsigned n = cov.size();
+      TH2D h("correlation","",n,0,n,n,0,n);
+      for (unsigned v=0; v<cov.vars.size(); ++v) {
+        const char* label = cov.vars[v].c_str();
+        h.GetXaxis()->SetBinLabel(cov.first[v]+1,label);
+        h.GetYaxis()->SetBinLabel(cov.first[v]+1,label);
+      }
+      h.GetXaxis()->SetLabelSize(0.02);
+      h.GetYaxis()->SetLabelSize(0.02);
+      draw_map(h,0,n);
+    }
+    for (unsigned v=0; v<cov.vars.size(); ++v) {
+      const unsigned first = cov.first[v], n = cov.first[v+1]-first;
+      if (!n) continue;
+      std::vector<double> edges;
+      for (unsigned i=0; i<n; ++i) edges.push_back(cov.bins[first+i].min);
+      edges.push_back(cov.bins[first+n-1].max);
+      TH2D h(("correlation_"+cov.vars[v]).c_str(),"",
+        n,edges.data(),n,edges.data());
+      const auto it = tex.find(cov.vars[v]);
+      const char* title = (it!=tex.end() ? it->second : cov.vars[v]).c_str();
+      for (TAxis* a : { h.GetXaxis(), h.GetYaxis() }) {
+        a->SetTitle(title);
+        a->SetTitleSize(0.05);
+        a->SetLabelSize(0.04);
+      }
+      draw_map(h,first,n);
+    }
+    canv.SaveAs((name+']').c_str());
+    count_output(name);
+  } catch (const std::exception& e) {
+    cerr <<"\033[31m"<< e.what() <<"\033[0m"<< endl;
+    status = 1;
+  }
+
+  if (profiler.enabled()) {
+    cout.flush();
+    profiler.report(cerr);
+    if (trace_file_name) try {
+      profiler.write_trace(trace_file_name);
+    } catch (const std::exception& e) {
+      cerr << "\033[33m" << e.what() << "\033[0m" << endl;
+    }
+    profiler.enable(false);
   }
-  if (!burst) canv.SaveAs(cat("uncert",corr  ? "_corr" : "",".pdf]").c_str());
+  return status;
+}
+
+// ==================================================================
+
+namespace {
+volatile sig_atomic_t stop = 0;
+void on_signal(int) { stop = 1; }
+
+// Restores gStyle and the palette changed by a request
+class style_guard {
+  TStyle style;
+  std::vector<int> palette;
+public:
+  style_guard() {
+    gStyle->Copy(style);
+    for (int i=0, n=gStyle->GetNumberOfColors(); i<n; ++i)
+      palette.push_back(gStyle->GetColorPalette(i));
+  }
+  ~style_guard() {
+    style.Copy(*gStyle);
+    gStyle->SetPalette(palette.size(),palette.data());
+  }
+};
+}
+
+// Handle requests from plotc one at a time, keeping ROOT initialized and
+// parsed inputs in memory between them
+int serve(const std::string& socket_name) {
+  const int sock = ::socket(AF_UNIX,SOCK_STREAM,0);
+  if (sock < 0) {
+    cerr <<"\033[31msocket: "<< std::strerror(errno) <<"\033[0m"<< endl;
+    return 1;
+  }
+  try {
+    const auto addr = plot_socket::address(socket_name);
+    ::unlink(socket_name.c_str());
+    const auto mask = ::umask(077); // only for this user
+    const int err = ::bind(sock,
+      reinterpret_cast<const sockaddr*>(&addr),sizeof(addr));
+    ::umask(mask);
+    if (err || ::listen(sock,16)) throw std::runtime_error(cat(
+      "cannot listen on ",socket_name,": ",std::strerror(errno)));
+  } catch (const std::exception& e) {
+    cerr <<"\033[31m"<< e.what() <<"\033[0m"<< endl;
+    ::close(sock);
+    return 1;
+  }
+
+  struct sigaction sa { };
+  sa.sa_handler = on_signal; // without SA_RESTART, to interrupt accept
+  ::sigaction(SIGINT,&sa,nullptr);
+  ::sigaction(SIGTERM,&sa,nullptr);
+  ::signal(SIGPIPE,SIG_IGN);
+
+  cout << "listening on " << socket_name << endl;
+  data_memory memory;
+  while (!stop) {
+    const int conn = ::accept(sock,nullptr,nullptr);
+    if (conn < 0) continue;
+    // a client that stalls is dropped, instead of blocking the daemon
+    const timeval timeout { 10, 0 };
+    ::setsockopt(conn,SOL_SOCKET,SO_RCVTIMEO,&timeout,sizeof(timeout));
+    ::setsockopt(conn,SOL_SOCKET,SO_SNDTIMEO,&timeout,sizeof(timeout));
+
+    std::vector<std::string> strs;
+    int fds[2];
+    if (!plot_socket::recv_request(conn,strs,fds)) {
+      ::close(conn);
+      continue;
+    }
+    if (strs.size() < 2) {
+      ::close(fds[0]);
+      ::close(fds[1]);
+      ::close(conn);
+      continue;
+    }
+
+    // write to the client's stdout and stderr, from its directory
+    cout.flush();
+    cerr.flush();
+    const int saved[2] = { ::dup(1), ::dup(2) };
+    ::dup2(fds[0],1);
+    ::dup2(fds[1],2);
+    ::close(fds[0]);
+    ::close(fds[1]);
+    char* cwd = ::getcwd(nullptr,0);
+
+    int32_t status = 1;
+    if (::chdir(strs[0].c_str())) {
+      cerr <<"\033[31mcannot change directory to "<< strs[0] <<": "
+           << std::strerror(errno) <<"\033[0m"<< endl;
+    } else {
+      std::vector<char*> args;
+      for (unsigned i=1; i<strs.size(); ++i) args.push_back(&strs[i][0]);
+      args.push_back(nullptr);
+      try {
+        style_guard style;
+        status = run(args.size()-1,args.data(),&memory);
+      } catch (const std::exception& e) {
+        cerr <<"\033[31m"<< e.what() <<"\033[0m"<< endl;
+      }
+    }
+
+    cout.flush();
+    cerr.flush();
+    if (cwd) { // back to the daemon's directory
+      if (::chdir(cwd)) cerr <<"\033[33mcannot change directory back to "
+                             << cwd <<"\033[0m"<< endl;
+      std::free(cwd);
+    }
+    ::dup2(saved[0],1);
+    ::dup2(saved[1],2);
+    ::close(saved[0]);
+    ::close(saved[1]);
+
+    plot_socket::write_all(conn,&status,sizeof(status));
+    ::close(conn);
+  }
+
+  ::close(sock);
+  ::unlink(socket_name.c_str());
+  return 0;
+}
+
+int main(int argc, char* argv[]) {
+  if (argc>1 && !strcmp(argv[1],"--daemon"))
+    return serve(argc>2 ? argv[2] : plot_socket::default_name());
+  return run(argc,argv,nullptr);
 }
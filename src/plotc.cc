@@ -0,0 +1,61 @@
+// Thin client of plot --daemon
+// Takes the same arguments as plot, and runs plot itself if no daemon
+// is listening
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "plot_socket.hh"
+
+using std::cerr;
+using std::endl;
+
+int main(int argc, char* argv[]) {
+  std::vector<std::string> strs;
+  { char* cwd = ::getcwd(nullptr,0);
+    if (!cwd) {
+      cerr << "\033[31mcannot get working directory\033[0m" << endl;
+      return 1;
+    }
+    strs.emplace_back(cwd);
+    std::free(cwd);
+  }
+  strs.insert(strs.end(),argv,argv+argc);
+
+  const int sock = ::socket(AF_UNIX,SOCK_STREAM,0);
+  bool connected = false;
+  try {
+    const auto addr = plot_socket::address(plot_socket::default_name());
+    connected = sock >= 0 && !::connect(sock,
+      reinterpret_cast<const sockaddr*>(&addr),sizeof(addr));
+  } catch (const std::exception& e) {
+    cerr << "\033[33m" << e.what() << "\033[0m" << endl;
+  }
+
+  if (!connected) { // run plot from the same directory as this program
+    if (sock >= 0) ::close(sock);
+    std::string plot = argv[0];
+    plot = plot.substr(0,plot.rfind('/')+1) + "plot";
+    argv[0] = &plot[0];
+    ::execvp(argv[0],argv); // searches PATH if there is no directory
+    cerr << "\033[31mno daemon running and cannot run "
+         << argv[0] << "\033[0m" << endl;
+    return 1;
+  }
+
+  int32_t status = 1;
+  if (!plot_socket::send_request(sock,strs,{1,2})
+      || !plot_socket::read_all(sock,&status,sizeof(status))) {
+    cerr << "\033[31mlost connection to daemon\033[0m" << endl;
+    status = 1;
+  }
+  ::close(sock);
+  return status;
+}
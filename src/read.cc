@@ -7,8 +7,17 @@
 #include <set>
 #include <algorithm>
 #include <stdexcept>
+#include <cstdint>
+#include <cctype>
+#include <cstring>
+#include <thread>
 
 #include "program_options.hh"
+#include "mapped_file.hh"
+#include "tokens.hh"
+#include "interner.hh"
+#include "simd.hh"
+#include "profile.hh"
 
 #define TEST(var) \
   std::cout <<"\033[36m"<< #var <<"\033[0m"<< " = " << var << std::endl;
@@ -16,14 +25,14 @@
 using std::cout;
 using std::cerr;
 using std::endl;
-using ivanp::cat;
+using namespace ivanp;
 
 template <size_t N> // find N delimeters
-inline auto findn(const std::string& s, char c, size_t pos=0) {
+inline auto findn(string_view s, char c, size_t pos=0) {
   std::array<size_t,N> ps{};
   for (size_t i=0; i<N; ++i) {
     pos = s.find(c,pos);
-    if (pos==std::string::npos) break;
+    if (pos==string_view::npos) break;
     ps[i] = pos;
     ++pos;
   }
@@ -50,11 +59,93 @@ inline std::string cont_str(const C& cont) {
   return ss.str();
 }
 
+// location of values in the arena
+struct entry {
+  size_t offset;
+  unsigned size;
+};
+
+inline uint64_t key(uint64_t mode, uint64_t var, uint64_t val) {
+  if ((mode|var|val) >> 21) throw std::length_error("too many keys");
+  return (mode << 42) | (var << 21) | val;
+}
+
+// Order in which std::unordered_map<std::string,...> iterates over
+// the names of ids(0), ..., ids(n-1) inserted in that order
+// Output used to come from such maps, and is kept in the same order
+template <typename F>
+std::vector<unsigned> hash_order(unsigned n, F&& ids, const interner& names) {
+  std::unordered_map<std::string,unsigned> m;
+  for (unsigned i=0; i<n; ++i) {
+    const unsigned id = ids(i);
+    m.emplace(names[id],id);
+  }
+  std::vector<unsigned> order;
+  order.reserve(m.size());
+  for (const auto& x : m) order.push_back(x.second);
+  return order;
+}
+
+// Parsed chunk of the input file
+// Records are kept in line order with local ids, to be merged in order
+struct shard {
+  const char *begin, *end;
+  size_t nlines = 0;
+  interner modes, vars, vals;
+  std::vector<double> arena;
+
+  struct record {
+    size_t line; // in this shard, from 1
+    string_view text; // line if bad, key if duplicate
+    bool bad;
+    unsigned mode, var, val; // local ids
+    size_t offset; // of values in arena
+    unsigned size;
+  };
+  std::vector<record> records;
+
+  shard(const char* begin, const char* end): begin(begin), end(end) { }
+
+  void parse() {
+    profile::timer timer("parse");
+    string_view line;
+    for (line_reader next(begin,end); next(line); ) {
+      ++nlines; // count lines
+
+      // skip blank lines and comments
+      if (line.size()==0) continue;
+      unsigned not_space = 0;
+      while (not_space<line.size() && std::isspace(line[not_space]))
+        ++not_space;
+      if (line.size()==not_space || line[not_space]=='#') continue;
+
+      // find delimiters
+      const auto d1s = findn<2>(line,'.',not_space);
+      const auto d2s = findn<1>(line,':',d1s.back()+1);
+      if (d1s[0]==0 || d1s[1]==0 || d2s[0]==0) {
+        records.push_back({nlines,line,true,0,0,0,0,0});
+        continue;
+      }
+
+      record r { nlines, line.substr(0,d2s[0]), false,
+        modes.intern(line.substr(0,d1s[0])),
+        vars.intern(line.substr(d1s[0]+1,d1s[1]-d1s[0]-1)),
+        vals.intern(line.substr(d1s[1]+1,d2s[0]-d1s[1]-1)),
+        arena.size(), 0 };
+      auto vals_str = line.substr(d2s[0]+1);
+      for (double x; next_double(vals_str,x); ) arena.push_back(x);
+      r.size = arena.size() - r.offset;
+      records.push_back(r);
+    }
+  }
+};
+
 int main(int argc, char* argv[]) {
-  const char* data_file_name;
+  const char *data_file_name, *trace_file_name = nullptr;
   bool no_warnings = false,
-       prt_bins = false, prt_modes = false, prt_vals = false;
+       prt_bins = false, prt_modes = false, prt_vals = false, prof = false;
   std::vector<const char*> vals;
+  unsigned nthreads = 1;
 
   try {
     using namespace ivanp::po;
@@ -65,96 +156,172 @@ int main(int argc, char* argv[]) {
       (prt_modes,"--prt-modes")
       (prt_vals,"--prt-vals")
       (no_warnings,"--no-warnings")
+      (nthreads,{"-t","--threads"},"parse input on N threads (0 = all)")
+      (prof,"--profile","print time spent in each phase, and counters")
+      (trace_file_name,"--trace","write --profile as Chrome trace to file")
       .parse(argc,argv,true)) return 0;
   } catch (const std::exception& e) {
     cerr <<"\033[31m"<< e.what() <<"\033[0m"<< endl;
     return 1;
   }
-
-  std::unordered_map<
-    std::string,
-    std::unordered_map<
-      std::string,
-      std::unordered_map<
-        std::string,
-        std::vector<double>
-      >
-    >
-  > data;
+  auto& profiler = profile::get();
+  profiler.enable(prof || trace_file_name);
 
   // ================================================================
-  { std::ifstream data_file(data_file_name);
-  for (std::string line; std::getline(data_file,line); ) {
-    static size_t line_i = 0;
-    ++line_i; // count lines
-
-    // skip blank lines and comments
-    if (line.size()==0) continue;
-    unsigned not_space = 0;
-    while (std::isspace(line[not_space])) ++not_space;
-    if (line.size()==not_space || line[not_space]=='#') continue;
-
-    // find delimiters
-    const auto d1s = findn<2>(line,'.',not_space);
-    const auto d2s = findn<1>(line,':',d1s.back()+1);
-    try {
-      for (auto d : d1s) if (d==0) throw 0;
-      if (d2s[0]==0) throw 0;
-    } catch(...) {
-      if (!no_warnings)
-        cerr << "\033[33mLine " << line_i
-             << ": unexpected formatting:\033[0m\n"
-             << line << endl;
-      continue;
-    }
+  // Keys are interned: mode, var and val names are given integer ids
+  // in order of first appearance, and all values are stored in one
+  // arena, indexed by (mode,var,val)
+  interner modes_ids, vars_ids, vals_ids;
+  std::vector<double> arena;
+  std::vector<entry> entries;
+  std::unordered_map<uint64_t,unsigned> index; // key -> entry
+  std::vector<std::vector<unsigned>> var_modes; // in order of appearance
 
-    // organize values in maps
-    auto& var = data[line.substr(d1s[0]+1,d1s[1]-d1s[0]-1)];
-    auto& mode = var[line.substr(0,d1s[0])];
-    auto& val = mode[line.substr(d1s[1]+1,d2s[0]-d1s[1]-1)];
-
-    if (val.size()) {
-      if (!no_warnings)
-        cerr << "\033[33mLine " << line_i
-             << ": duplicate entry for:\033[0m\n"
-             << line.substr(0,d2s[0]) << endl;
-      continue;
+  try {
+    profile::timer map_timer("map");
+    const mapped_file data_file(data_file_name);
+    profile::count("bytes read",data_file.size());
+    map_timer.stop();
+
+    // parse line aligned chunks of the file in parallel
+    if (nthreads==0) nthreads = std::thread::hardware_concurrency();
+    if (nthreads==0) nthreads = 1;
+    std::vector<shard> shards;
+    shards.reserve(nthreads);
+    for (const char *a = data_file.begin(), *end = data_file.end(); a!=end; ) {
+      const char* b = shards.size()+1 < nthreads
+        ? a + (end-a)/(nthreads-shards.size()) : end;
+      if (b!=end) {
+        b = static_cast<const char*>(std::memchr(b,'\n',end-b));
+        b = b ? b+1 : end;
+      }
+      shards.emplace_back(a,b);
+      a = b;
+    }
+    { std::vector<std::thread> threads;
+      for (unsigned i=1; i<shards.size(); ++i)
+        threads.emplace_back(&shard::parse,&shards[i]);
+      if (shards.size()) shards[0].parse();
+      for (auto& t : threads) t.join();
     }
 
-    std::istringstream ss(line.substr(d2s[0]+1));
-    for (double x; ss >> x; ) val.push_back(x);
+    // merge shards in file order
+    profile::timer merge_timer("merge");
+    size_t nvals = 0, nrecords = 0, nlines = 0;
+    for (const auto& sh : shards) {
+      nvals += sh.arena.size();
+      nrecords += sh.records.size();
+      nlines += sh.nlines;
+    }
+    profile::count("lines",nlines);
+    profile::count("records",nrecords);
+    profile::count("values",nvals);
+    arena.reserve(nvals);
+
+    size_t line0 = 0; // lines in previous shards
+    for (auto& sh : shards) {
+      std::vector<unsigned> gmode, gvar, gval; // local -> global ids
+      for (unsigned i=0; i<sh.modes.size(); ++i)
+        gmode.push_back(modes_ids.intern(sh.modes[i]));
+      for (unsigned i=0; i<sh.vars.size(); ++i)
+        gvar.push_back(vars_ids.intern(sh.vars[i]));
+      for (unsigned i=0; i<sh.vals.size(); ++i)
+        gval.push_back(vals_ids.intern(sh.vals[i]));
+      var_modes.resize(vars_ids.size());
+
+      const size_t base = arena.size();
+      arena.insert(arena.end(),sh.arena.begin(),sh.arena.end());
+
+      for (const auto& r : sh.records) {
+        const size_t line_i = line0 + r.line;
+        if (r.bad) {
+          if (!no_warnings)
+            cerr << "\033[33mLine " << line_i
+                 << ": unexpected formatting:\033[0m\n"
+                 << r.text << endl;
+          continue;
+        }
 
-  }} // end lines loop
+        const unsigned mode = gmode[r.mode], var = gvar[r.var];
+        const auto emp = index.emplace(
+          key(mode,var,gval[r.val]), entries.size());
+        if (emp.second) {
+          if (std::find(var_modes[var].begin(),var_modes[var].end(),mode)
+              == var_modes[var].end()) var_modes[var].push_back(mode);
+          entries.push_back({0,0});
+        } else if (entries[emp.first->second].size) {
+          if (!no_warnings)
+            cerr << "\033[33mLine " << line_i
+                 << ": duplicate entry for:\033[0m\n"
+                 << r.text << endl;
+          continue;
+        }
+        entries[emp.first->second] = { base + r.offset, r.size };
+      }
+      line0 += sh.nlines;
+      sh = shard(nullptr,nullptr); // free memory
+    }
+  } catch (const std::exception& e) {
+    cerr <<"\033[31m"<< e.what() <<"\033[0m"<< endl;
+    return 1;
+  }
   // ================================================================
 
+  const auto at = [&](unsigned mode, unsigned var, unsigned val)
+  -> const entry* {
+    const auto it = index.find(key(mode,var,val));
+    return it!=index.end() ? &entries[it->second] : nullptr;
+  };
+  const auto same = [&](const entry& a, const entry& b){
+    return a.size==b.size && std::equal(
+      arena.begin()+a.offset, arena.begin()+a.offset+a.size,
+      arena.begin()+b.offset);
+  };
+
+  profile::timer check_timer("check");
+  // iteration orders of the former string keyed unordered_maps
+  const auto vars_order = hash_order(var_modes.size(),
+    [](unsigned i){ return i; }, vars_ids);
+  std::vector<std::vector<unsigned>> modes_order(var_modes.size());
+  for (unsigned v=0; v<var_modes.size(); ++v)
+    modes_order[v] = hash_order(var_modes[v].size(),
+      [&](unsigned i){ return var_modes[v][i]; }, modes_ids);
+
   // check binning for consistency ----------------------------------
+  const int bins_id = vals_ids.find("bins");
   std::unordered_map<
     std::string,
-    const std::vector<double>*
+    const entry*
   > bins;
 
-  for (const auto& var : data) {
-    static const std::vector<double>* v0 = nullptr;
-    for (const auto& mode : var.second) {
-      const auto* v = &mode.second.at("bins");
+  for (const unsigned var : vars_order) {
+    const entry* v0 = nullptr;
+    for (const unsigned mode : modes_order[var]) {
+      const entry* v = bins_id<0 ? nullptr : at(mode,var,bins_id);
+      if (!v) {
+        cerr << "\033[31mNo binning for:\033[0m "
+             << modes_ids[mode] << '.' << vars_ids[var] << endl;
+        return 1;
+      }
       if (v0) {
         // compare vectors
-        if (*v != *v0) {
+        if (!same(*v,*v0)) {
           cerr << "\033[31mInconsistent binning at:\033[0m "
-               << mode.first << '.' << var.first << ".bins" << endl;
+               << modes_ids[mode] << '.' << vars_ids[var] << ".bins" << endl;
           return 1;
         }
       } else v0 = v;
     }
-    bins[var.first] = v0;
-    v0 = nullptr;
+    bins[vars_ids[var]] = v0;
   }
 
+  check_timer.stop();
+
   if (prt_bins) { // option to print bins
     for (const auto& var : bins) {
       cout << var.first << ':';
-      for (const auto& x : *var.second) {
-        cout << ' ' << x;
+      for (unsigned i=0; i<var.second->size; ++i) {
+        cout << ' ' << arena[var.second->offset+i];
       }
       cout << '\n';
     }
@@ -162,24 +329,27 @@ int main(int argc, char* argv[]) {
   }
 
   // check modes for consistency ------------------------------------
+  profile::timer modes_timer("check");
   std::set<ref<std::string>> modes;
 
-  for (const auto& var : data) {
-    static const auto* var1 = &var.first;
+  for (const unsigned var : vars_order) {
+    static const auto* var1 = &vars_ids[var];
     decltype(modes) m;
-    for (const auto& mode : var.second) {
-      m.insert({&mode.first});
+    for (const unsigned mode : modes_order[var]) {
+      m.insert({&modes_ids[mode]});
     }
     if (modes.size()) {
       if (m != modes) {
         cerr << "\033[31mInconsistent modes:\033[0m\n"
              << *var1 << ": " << cont_str(modes) << '\n'
-             << var.first << ": " << cont_str(m) << endl;
+             << vars_ids[var] << ": " << cont_str(m) << endl;
         return 1;
       }
     } else modes = std::move(m);
   }
 
+  modes_timer.stop();
+
   if (prt_modes) {
     for (const auto& m : modes) cout << m << '\n';
     cout << endl;
@@ -187,17 +357,9 @@ int main(int argc, char* argv[]) {
 
   // print values ---------------------------------------------------
   if (prt_vals) {
-    std::set<ref<std::string>> vals_set;
-
-    for (const auto& var : data) {
-      for (const auto& mode : var.second)
-        for (const auto& val : mode.second)
-          vals_set.insert({&val.first});
-    }
-
     std::vector<ref<std::string>> vals;
-    vals.reserve(vals_set.size());
-    for (auto& v : vals_set) vals.push_back(v);
+    vals.reserve(vals_ids.size());
+    for (unsigned i=0; i<vals_ids.size(); ++i) vals.push_back({&vals_ids[i]});
 
     std::sort(vals.begin(),vals.end());
     for (auto& v : vals) cout << v << '\n';
@@ -215,31 +377,48 @@ int main(int argc, char* argv[]) {
     >> sums;
     for (auto v : vals) sums[v];
 
-    for (const auto& var : data) {
+    profile::timer sum_timer("sum");
+    // validate before summing -----------------------------------
+    // every mode must have the value with the same number of entries
+    // (modes with no entries before the first non-empty one are skipped)
+    std::vector<const double*> rows; // for each (var,val), modes' values
+    struct task { std::vector<double>* xs; size_t rows, nrows, n; };
+    std::vector<task> tasks;
+
+    for (const unsigned var : vars_order) {
       for (auto& sum : sums) {
-        auto& xs = sum.second[var.first];
-        for (const auto& mode : var.second) {
-          try {
-            const auto& v = mode.second.at(sum.first);
-            const auto n = xs.size();
-            if (n) {
-              if (v.size()!=n) {
-                cerr << "\033[31mUnequal number of sumues for:\033[0m "
-                     << mode.first << '.' << var.first << '.' << sum.first
-                     << endl;
-                return 1;
-              }
-              for (unsigned i=0; i<n; ++i) xs[i] += v[i];
-            } else xs = v;
-          } catch(const std::out_of_range& e) {
-            cerr << "\033[31m" << mode.first << '.' << var.first
+        const int val = vals_ids.find(sum.first);
+        task t { &sum.second[vars_ids[var]], rows.size(), 0, 0 };
+        for (const unsigned mode : modes_order[var]) {
+          const entry* e = val<0 ? nullptr : at(mode,var,val);
+          if (!e) {
+            cerr << "\033[31m" << modes_ids[mode] << '.' << vars_ids[var]
                  << " has no value " << sum.first << "\033[0m" << endl;
             return 1;
           }
+          if (t.n) {
+            if (e->size!=t.n) {
+              cerr << "\033[31mUnequal number of sumues for:\033[0m "
+                   << modes_ids[mode] << '.' << vars_ids[var] << '.'
+                   << sum.first << endl;
+              return 1;
+            }
+          } else if (!(t.n = e->size)) continue;
+          rows.push_back(arena.data() + e->offset);
+          ++t.nrows;
         }
+        tasks.push_back(t);
       }
     }
 
+    // sum ----------------------------------------------------------
+    for (const auto& t : tasks) {
+      t.xs->resize(t.n);
+      simd::sum_rows(rows.data()+t.rows, t.nrows, t.n, t.xs->data());
+    }
+    sum_timer.stop();
+
+    profile::timer print_timer("print");
     for (const auto& val : sums) {
       cout << "\033[0;1m" << val.first << "\033[0m\n";
       for (const auto& var : val.second) {
@@ -252,4 +431,12 @@ int main(int argc, char* argv[]) {
 
   }
 
+  if (profiler.enabled()) {
+    profiler.report(cerr);
+    if (trace_file_name) try {
+      profiler.write_trace(trace_file_name);
+    } catch (const std::exception& e) {
+      cerr << "\033[33m" << e.what() << "\033[0m" << endl;
+    }
+  }
 }
@@ -0,0 +1,327 @@
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+#include <atomic>
+#include <memory>
+
+#include "toys.hh"
+#include "philox.hh"
+#include "simd.hh"
+#include "string.hh"
+#include "hash.hh"
+#include "profile.hh"
+
+using namespace ivanp;
+
+namespace hepdata {
+
+bands_t toy_result_t::bands() const {
+  bands_t b;
+  b.edges = edges;
+  for (unsigned g=0; g<q16.size(); ++g) {
+    std::vector<double> t(q16[g].size());
+    for (unsigned i=0; i<t.size(); ++i) t[i] = (q84[g][i]-q16[g][i])/2;
+    b.tuncs.push_back(std::move(t));
+  }
+  return b;
+}
+
+namespace {
+
+constexpr unsigned T = 64;       // toys in a tile, rows of the product
+constexpr unsigned chunk = 4096; // toys with moments summed together
+constexpr unsigned H = 512;      // histogram bins for quantiles
+constexpr double range = 8;      // histograms span +-range x largest shift
+
+}
+
+std::map<std::string,toy_result_t> run_toys(
+  const data_t& data, const groups_t& groups, const toys_config& config
+) {
+  profile::timer timer("toys");
+  if (!groups.compiled(data.sources)) throw std::logic_error(
+    "groups are not compiled for the sources of toys");
+  if (!config.ntoys) throw std::runtime_error("no toys");
+  const unsigned G = groups.size(), nsources = data.sources.size();
+
+  // bins of all variables
+  std::vector<unsigned> first;
+  unsigned n = 0;
+  for (const auto& var : data.vars) {
+    first.push_back(n);
+    n += var.second.nbins();
+  }
+  first.push_back(n);
+  const unsigned nvars = data.vars.size();
+
+  // Rows of shifts and mids of correlated sources, relative to cross
+  // sections, over all bins. Mids are kept only for asymmetric sources.
+  // Uncorrelated contributions and the largest shifts are summed in
+  // quadrature for each group and bin.
+  std::vector<char> is_uncorr(nsources);
+  for (const auto& name : config.uncorr) {
+    const int id = data.sources.find(name);
+    if (id >= 0) is_uncorr[id] = true;
+  }
+  std::vector<int> row_of(nsources,-1), mid_of;
+  std::vector<unsigned> row_group;
+  std::vector<uint64_t> row_key; // hashes of source names
+  std::vector<std::vector<double>> shifts, mids;
+  std::vector<std::vector<double>> usig(G,std::vector<double>(n)),
+                                   bound(G,std::vector<double>(n));
+  { unsigned v = 0;
+    for (const auto& x : data.vars) {
+      const var_t& var = x.second;
+      const auto& bins = var.bins;
+      const unsigned o = first[v++], nbins = var.nbins();
+      for (unsigned g=0; g<G; ++g)
+        if (groups.has_stat(g))
+          for (unsigned i=0; i<nbins; ++i) {
+            const double s = bins[i].stat/bins[i].xsec;
+            usig[g][o+i] += s*s;
+          }
+      for (unsigned c=0; c<var.ncols(); ++c) {
+        const unsigned id = var.src[c];
+        const int g = groups.group_of(id);
+        if (g < 0) continue;
+        const double *s = var.col_shift(c), *m = var.col_mid(c);
+        const unsigned char* has = var.col_has(c);
+        if (is_uncorr[id]) {
+          for (unsigned i=0; i<nbins; ++i)
+            if (has[i]) {
+              const double x = s[i]/bins[i].xsec;
+              usig[g][o+i] += x*x;
+            }
+          continue;
+        }
+        int& row = row_of[id];
+        if (row < 0) {
+          row = shifts.size();
+          shifts.emplace_back(n);
+          row_group.push_back(g);
+          row_key.push_back(hash64(data.sources[id].data(),
+                                   data.sources[id].size()));
+          mid_of.push_back(-1);
+        }
+        for (unsigned i=0; i<nbins; ++i) {
+          if (!has[i]) continue;
+          const double xs = s[i]/bins[i].xsec, xm = m[i]/bins[i].xsec;
+          shifts[row][o+i] = xs;
+          if (xm != 0) {
+            if (mid_of[row] < 0) {
+              mid_of[row] = mids.size();
+              mids.emplace_back(n);
+            }
+            mids[mid_of[row]][o+i] = xm;
+          }
+          const double b = std::abs(xs) + std::abs(xm);
+          bound[g][o+i] += b*b;
+        }
+      }
+    }
+  }
+  const unsigned nrows = shifts.size(), nmids = mids.size();
+  for (unsigned g=0; g<G; ++g)
+    for (unsigned i=0; i<n; ++i) {
+      bound[g][i] += usig[g][i] + (g ? bound[g-1][i] : 0.);
+      usig[g][i] = std::sqrt(usig[g][i]);
+    }
+  for (unsigned g=0; g<G; ++g)
+    for (unsigned i=0; i<n; ++i) bound[g][i] = std::sqrt(bound[g][i]);
+  std::vector<char> has_usig(G);
+  for (unsigned g=0; g<G; ++g)
+    has_usig[g] = std::any_of(usig[g].begin(),usig[g].end(),
+      [](double x){ return x!=0; });
+
+  // rows of each group: shifts by x, then mids by |x|
+  std::vector<std::vector<unsigned>> group_rows(G), group_mids(G);
+  for (unsigned r=0; r<nrows; ++r) {
+    group_rows[row_group[r]].push_back(r);
+    if (mid_of[r] >= 0) group_mids[row_group[r]].push_back(r);
+  }
+
+  // Random numbers of a toy are keyed by the toy index and by names, so
+  // that the toys of a variable don't depend on the other variables:
+  // the nuisance parameter of a source by the name of the source, and
+  // those of bins, for uncorrelated contributions, by the names of the
+  // variable and group
+  const philox rng(config.seed);
+  std::vector<philox> bin_rngs;
+  for (unsigned g=0; g<G; ++g)
+    for (const auto& var : data.vars)
+      bin_rngs.emplace_back(config.seed ^ hasher()(var.first)(g).value());
+
+  const unsigned long ntoys = config.ntoys;
+  const unsigned nchunks = (ntoys+chunk-1)/chunk;
+  const size_t nvals = size_t(G)*n;
+  unsigned nthreads = config.nthreads;
+  if (nthreads==0) nthreads = std::thread::hardware_concurrency();
+  nthreads = std::max(1u,std::min(nthreads,nchunks));
+
+  // Toys are done in chunks, taken by threads in any order
+  // Moments are summed in toy order within each chunk, in one of a window
+  // of slots, and published by storing the chunk index. Published chunks
+  // are added to the totals in order by whichever thread gets the reducer
+  // flag, and a thread that finds the flag taken leaves its chunk to the
+  // holder, which checks again after letting it go. A chunk spins for its
+  // slot to be free, which only happens when the window is overtaken.
+  // Histograms hold counts, which add up the same in any order, so each
+  // thread keeps its own.
+  const unsigned nslots = 2*nthreads;
+  std::vector<std::vector<double>> slot_sum(nslots), slot_sum2(nslots);
+  std::unique_ptr<std::atomic<unsigned>[]> published(
+    new std::atomic<unsigned>[nslots]);
+  for (unsigned i=0; i<nslots; ++i) published[i] = 0; // chunk index + 1
+  std::atomic<unsigned> nreduced{0};
+  std::atomic<bool> reducing{false};
+  std::vector<double> sum(nvals), sum2(nvals);
+  std::vector<std::vector<uint32_t>> hists(nthreads);
+
+  auto reduce = [&]{
+    while (!reducing.exchange(true)) {
+      unsigned r = nreduced;
+      for (unsigned s; published[s = r % nslots] == r+1; ) {
+        const auto &s1 = slot_sum[s], &s2 = slot_sum2[s];
+        for (size_t i=0; i<nvals; ++i) sum[i] += s1[i], sum2[i] += s2[i];
+        nreduced = ++r;
+      }
+      reducing = false;
+      // a chunk published after the check above
+      if (published[r % nslots] != r+1) break;
+    }
+  };
+
+  std::atomic<unsigned> next_chunk{0};
+  auto worker = [&](std::vector<uint32_t>& hist){
+    hist.assign(nvals*H,0);
+    std::vector<double> x(size_t(nrows)*T), ax(size_t(nmids)*T),
+                        c(size_t(T)*n), z(n);
+    // pointers to rows for outer_sums, by group
+    std::vector<std::vector<const double*>> a(G), b(G);
+    for (unsigned g=0; g<G; ++g) {
+      for (unsigned r : group_rows[g]) {
+        a[g].push_back(x.data() + size_t(r)*T);
+        b[g].push_back(shifts[r].data());
+      }
+      for (unsigned r : group_mids[g]) {
+        a[g].push_back(ax.data() + size_t(mid_of[r])*T);
+        b[g].push_back(mids[mid_of[r]].data());
+      }
+    }
+    std::vector<double*> crow(T);
+    for (unsigned t=0; t<T; ++t) crow[t] = c.data() + size_t(t)*n;
+
+    for (unsigned k; (k = next_chunk++) < nchunks; ) {
+      const unsigned slot = k % nslots;
+      while (k >= nreduced+nslots) std::this_thread::yield();
+      auto& csum = slot_sum[slot];
+      auto& csum2 = slot_sum2[slot];
+      csum.assign(nvals,0.);
+      csum2.assign(nvals,0.);
+      const unsigned long end = std::min(ntoys,(unsigned long)(k+1)*chunk);
+      for (unsigned long t0 = (unsigned long)k*chunk; t0<end; t0+=T) {
+        const unsigned nt = std::min<unsigned long>(T,end-t0);
+        // nuisance parameters of correlated sources, 4 toys per counter
+        for (unsigned r=0; r<nrows; ++r)
+          rng.normals(t0/4,uint32_t(row_key[r]),uint32_t(row_key[r]>>32),
+                      nt,x.data()+size_t(r)*T);
+        for (unsigned r=0; r<nrows; ++r)
+          if (mid_of[r] >= 0)
+            for (unsigned t=0; t<nt; ++t)
+              ax[size_t(mid_of[r])*T+t] = std::abs(x[size_t(r)*T+t]);
+
+        std::fill(c.begin(),c.end(),0.);
+        for (unsigned g=0; g<G; ++g) {
+          // sums of shifts, cumulative over groups
+          const unsigned na = a[g].size();
+          unsigned t = 0;
+          for (; t+4<=nt; t+=4)
+            simd::outer_sums<4>(a[g].data(),b[g].data(),na,t,0,n,&crow[t]);
+          for (; t<nt; ++t)
+            simd::outer_sums<1>(a[g].data(),b[g].data(),na,t,0,n,&crow[t]);
+
+          const double* us = usig[g].data();
+          const double* bd = bound[g].data();
+          double* s1 = csum.data() + size_t(g)*n;
+          double* s2 = csum2.data() + size_t(g)*n;
+          uint32_t* h = hist.data() + size_t(g)*n*H;
+          for (unsigned t=0; t<nt; ++t) {
+            double* ct = crow[t];
+            if (has_usig[g]) { // independent in every bin
+              const uint64_t toy = t0+t;
+              for (unsigned v=0; v<nvars; ++v)
+                bin_rngs[g*nvars+v].normals(0,uint32_t(toy),uint32_t(toy>>32),
+                  first[v+1]-first[v],z.data()+first[v]);
+              for (unsigned i=0; i<n; ++i) ct[i] += us[i]*z[i];
+            }
+            for (unsigned i=0; i<n; ++i) {
+              const double v = ct[i];
+              s1[i] += v;
+              s2[i] += v*v;
+              if (bd[i] > 0) {
+                const double f = (v/bd[i] + range)*(H/(2*range));
+                const unsigned j = f <= 0 ? 0 : f >= H ? H-1 : unsigned(f);
+                ++h[size_t(i)*H+j];
+              }
+            }
+          }
+        }
+      }
+
+      published[slot] = k+1;
+      reduce();
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (unsigned i=1; i<nthreads; ++i)
+    threads.emplace_back(worker,std::ref(hists[i]));
+  worker(hists[0]);
+  for (auto& t : threads) t.join();
+  profile::count("toys",ntoys);
+
+  // moments and quantiles
+  auto& hist = hists[0];
+  for (unsigned h=1; h<nthreads; ++h)
+    for (size_t i=0; i<hist.size(); ++i) hist[i] += hists[h][i];
+
+  auto quantile = [&](unsigned g, unsigned i, double p){
+    const double bd = bound[g][i];
+    if (!(bd > 0)) return 0.;
+    const uint32_t* h = hist.data() + (size_t(g)*n+i)*H;
+    const double target = p*ntoys, width = 2*range*bd/H;
+    double cum = 0;
+    for (unsigned j=0; j<H; ++j) {
+      if (h[j] && cum+h[j] >= target)
+        return -range*bd + (j + (target-cum)/h[j])*width;
+      cum += h[j];
+    }
+    return range*bd;
+  };
+
+  std::map<std::string,toy_result_t> out;
+  unsigned v = 0;
+  for (const auto& var : data.vars) {
+    auto& r = out[var.first];
+    const auto& bins = var.second.bins;
+    for (const auto& b : bins) r.edges.push_back(b.min);
+    r.edges.push_back(bins.back().max);
+    const unsigned o = first[v++], nbins = bins.size();
+    for (auto* q : { &r.mean, &r.sd, &r.q16, &r.q50, &r.q84 })
+      q->assign(G,std::vector<double>(nbins));
+    for (unsigned g=0; g<G; ++g)
+      for (unsigned i=0; i<nbins; ++i) {
+        const size_t k = size_t(g)*n + o+i;
+        const double mean = sum[k]/ntoys;
+        r.mean[g][i] = mean;
+        r.sd[g][i] = std::sqrt(std::max(0.,sum2[k]/ntoys - mean*mean));
+        r.q16[g][i] = quantile(g,o+i,0.158655253931457);
+        r.q50[g][i] = quantile(g,o+i,0.5);
+        r.q84[g][i] = quantile(g,o+i,0.841344746068543);
+      }
+  }
+  return out;
+}
+
+}
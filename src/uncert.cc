@@ -0,0 +1,403 @@
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <unordered_map>
+
+#include <fnmatch.h>
+
+#include "uncert.hh"
+
+#include "mapped_file.hh"
+#include "tokens.hh"
+#include "string.hh"
+#include "math.hh"
+#include "algebra.hh"
+#include "lists.hh"
+#include "simd.hh"
+
+using namespace ivanp;
+using namespace ivanp::math;
+
+namespace hepdata {
+
+namespace {
+
+// ids of sources that are not correction factor contributions
+struct not_cf {
+  int lumi, fit, bkg;
+  not_cf(const sources_t& sources)
+  : lumi(sources.find("lumi")), fit(sources.find("fit")),
+    bkg(sources.find("bkg_model_uncorr")) { }
+  bool operator()(int id) const noexcept {
+    return id==lumi || id==fit || id==bkg;
+  }
+};
+
+// Correction factor columns given in any bin, in column order,
+// with sums of squares of their relative uncertainties in each bin
+std::vector<std::pair<unsigned,double>> cf_totals(
+  const data_t& data, const var_t& var
+) {
+  const not_cf skip(data.sources);
+  const auto& bins = var.bins;
+  const unsigned nbins = var.nbins(), ncols = var.ncols();
+  std::vector<std::pair<unsigned,double>> totals;
+  totals.reserve(ncols);
+  for (unsigned c=0; c<ncols; ++c) {
+    if (skip(var.src[c])) continue;
+    const double* u = var.col(c);
+    const unsigned char* has = var.col_has(c);
+    double total = 0;
+    bool any = false;
+    for (unsigned i=0; i<nbins; ++i)
+      if (has[i]) total += sq(u[i]/bins[i].xsec), any = true;
+    if (any) totals.emplace_back(c,total);
+  }
+  return totals;
+}
+
+// First elements of the n largest totals, from the smallest
+// Equal totals are ranked in the order in which they are given
+// Only the selected ones are sorted, using a heap of n elements
+std::vector<unsigned> top_n(
+  std::vector<std::pair<unsigned,double>>& totals, unsigned n
+) {
+  n = std::min<size_t>(n,totals.size());
+  using total = std::pair<unsigned,double>;
+  std::partial_sort(totals.begin(),totals.begin()+n,totals.end(),
+    [](const total& a, const total& b){
+      return a.second > b.second || (a.second==b.second && a.first < b.first);
+    });
+  std::vector<unsigned> top;
+  top.reserve(n);
+  for (unsigned i=n; i; ) top.push_back(totals[--i].first);
+  return top;
+}
+
+}
+
+std::vector<unsigned> rank_sources(const data_t& data, unsigned n) {
+  std::vector<double> totals(data.sources.size());
+  std::vector<char> given(totals.size());
+  for (const auto& var : data.vars)
+    for (const auto& t : cf_totals(data,var.second)) {
+      const unsigned id = var.second.src[t.first];
+      totals[id] += t.second;
+      given[id] = true;
+    }
+  std::vector<std::pair<unsigned,double>> ranked;
+  for (unsigned id=0; id<totals.size(); ++id)
+    if (given[id]) ranked.emplace_back(id,totals[id]);
+  return top_n(ranked,n);
+}
+
+bands_t make_bands(
+  const data_t& data, const std::string& name, const var_t& var,
+  bool corr, std::ostream* log
+) {
+  if (!corr) {
+    groups_t groups = default_groups();
+    groups.compile(data.sources);
+    return make_bands(data,name,var,groups);
+  }
+  return make_bands(data,name,var,corr_t(),log);
+}
+
+bands_t make_bands(
+  const data_t& data, const std::string& name, const var_t& var,
+  const corr_t& corr, std::ostream* log
+) {
+  const auto& sources = data.sources;
+  const auto& bins = var.bins;
+  const unsigned nbins = var.nbins();
+  bands_t out;
+
+  // value of uncertainty source in bin, checking that it was given
+  auto unc_at = [&](int c, unsigned i, int line) {
+    if (c<0 || !var.col_has(c)[i]) throw std::out_of_range(cat(
+      "no uncertainty ",c<0 ? "" : sources[var.src[c]],
+      " in bin ",i," of ",name," at line ",line));
+    return var.col(c)[i];
+  };
+
+  auto& corr_selected = out.corr_selected;
+  auto& corr_other = out.corr_other;
+  { // select most significant contributions
+    auto totals = cf_totals(data,var);
+    if (corr.sources.empty()) corr_selected = top_n(totals,corr.n);
+    else for (unsigned id : corr.sources) { // ranked over all variables
+      const int c = var.find(id);
+      if (c >= 0) corr_selected.push_back(c);
+    }
+    std::vector<char> selected(var.ncols());
+    for (unsigned c : corr_selected) selected[c] = true;
+    // the rest in column order
+    std::sort(totals.begin(),totals.end());
+    for (const auto& t : totals)
+      if (!selected[t.first]) corr_other.push_back(t.first);
+  }
+
+  // collect bin edges
+  out.edges = ( bins | [](const auto& b){ return b.min; } )
+            << bins.back().max;
+
+  // columns of each band, for the fused quadrature kernel
+  std::vector<const double*> cols;
+  std::vector<unsigned> first { 0 }; // first column of each band
+  auto band = [&]{ first.push_back(cols.size()); };
+  // sources that must be given in every bin
+  auto required = [&](int c, int line) {
+    for (unsigned i=0; i<nbins; ++i) unc_at(c,i,line);
+    cols.push_back(var.col(c));
+  };
+  std::vector<double> xsec(nbins);
+  for (unsigned i=0; i<nbins; ++i) xsec[i] = bins[i].xsec;
+
+  if (log) for (unsigned i=0; i<nbins; ++i) {
+    *log << bins[i].min << std::endl;
+    for (unsigned c : corr_selected)
+      *log <<"  "<< sources[var.src[c]] <<' '<< unc_at(c,i,__LINE__)
+           << std::endl;
+  }
+  for (unsigned c : corr_selected) {
+    required(c,__LINE__);
+    band();
+  }
+  for (unsigned c : corr_other) required(c,__LINE__);
+  band();
+
+  // partial sums in quadrature, divided by cross section
+  auto& tuncs = out.tuncs;
+  tuncs.assign(first.size()-1,std::vector<double>(nbins));
+  std::vector<double*> tuncs_ptrs;
+  for (auto& t : tuncs) tuncs_ptrs.push_back(t.data());
+  simd::quad_bands(cols.data(),first.data(),tuncs.size(),
+    nbins,xsec.data(),tuncs_ptrs.data());
+
+  return out;
+}
+
+bands_t make_bands(
+  const data_t& data, const std::string& name, const var_t& var,
+  const groups_t& groups
+) {
+  const auto& bins = var.bins;
+  const unsigned nbins = var.nbins(), ncols = var.ncols(),
+                 ngroups = groups.size();
+  if (!groups.compiled(data.sources)) throw std::logic_error(cat(
+    "groups are not compiled for the sources of ",name));
+  bands_t out;
+
+  // collect bin edges
+  out.edges = ( bins | [](const auto& b){ return b.min; } )
+            << bins.back().max;
+
+  // columns of each group, in column order
+  std::vector<std::vector<const double*>> members(ngroups);
+  for (unsigned c=0; c<ncols; ++c) {
+    const int g = groups.of_source[var.src[c]];
+    if (g >= 0) members[g].push_back(var.col(c));
+  }
+
+  std::vector<double> stat, xsec(nbins);
+  for (unsigned i=0; i<nbins; ++i) xsec[i] = bins[i].xsec;
+  if (std::find(groups.stat.begin(),groups.stat.end(),true)
+      != groups.stat.end())
+    stat = bins | [](const auto& b){ return b.stat; };
+
+  std::vector<const double*> cols;
+  std::vector<unsigned> first { 0 }; // first column of each band
+  for (unsigned g=0; g<ngroups; ++g) {
+    // named sources must be given in every bin
+    for (const auto& r : groups.required[g]) {
+      const int c = var.find(r.first);
+      const char* src = groups[g].patterns[r.second].c_str()+1;
+      if (c < 0) throw std::out_of_range(cat(
+        "no uncertainty ",src," in ",name));
+      const unsigned char* has = var.col_has(c);
+      for (unsigned i=0; i<nbins; ++i)
+        if (!has[i]) throw std::out_of_range(cat(
+          "no uncertainty ",src," in bin ",i," of ",name));
+    }
+    cols.insert(cols.end(),members[g].begin(),members[g].end());
+    if (groups.stat[g]) cols.push_back(stat.data());
+    first.push_back(cols.size());
+  }
+
+  // partial sums in quadrature, divided by cross section
+  auto& tuncs = out.tuncs;
+  tuncs.assign(ngroups,std::vector<double>(nbins));
+  std::vector<double*> tuncs_ptrs;
+  for (auto& t : tuncs) tuncs_ptrs.push_back(t.data());
+  simd::quad_bands(cols.data(),first.data(),ngroups,
+    nbins,xsec.data(),tuncs_ptrs.data());
+
+  return out;
+}
+
+groups_t::groups_t(std::vector<group_t> groups): groups(std::move(groups)) { }
+
+void groups_t::compile(const sources_t& sources) {
+  const unsigned ngroups = groups.size();
+  nsources = sources.size();
+  of_source.assign(nsources,-1);
+  required.assign(ngroups,{});
+  stat.assign(ngroups,false);
+
+  auto is_pattern = [](const std::string& p){
+    return p.find_first_of("*?[") != std::string::npos;
+  };
+  for (unsigned g=0; g<ngroups; ++g) {
+    const auto& patterns = groups[g].patterns;
+    for (unsigned k=0; k<patterns.size(); ++k) {
+      const auto& p = patterns[k];
+      if (p=="@stat") stat[g] = true;
+      else if (p[0]=='!') { // required
+        const int id = sources.find(p.substr(1));
+        required[g].emplace_back(id,k);
+        if (id >= 0 && of_source[id] < 0) of_source[id] = g;
+      } else if (!is_pattern(p)) {
+        const int id = sources.find(p);
+        if (id >= 0 && of_source[id] < 0) of_source[id] = g;
+      }
+    }
+  }
+
+  for (unsigned id=0; id<nsources; ++id) {
+    if (of_source[id] >= 0) continue;
+    const char* src = sources[id].c_str();
+    int any = -1;
+    for (unsigned g=0; g<ngroups && of_source[id] < 0; ++g)
+      for (const auto& p : groups[g].patterns) {
+        if (p=="*") {
+          if (any < 0) any = g;
+        } else if (is_pattern(p) && !::fnmatch(p.c_str(),src,0)) {
+          of_source[id] = g;
+          break;
+        }
+      }
+    if (of_source[id] < 0) of_source[id] = any;
+  }
+}
+
+const groups_t& default_groups() {
+  static const groups_t groups({
+    { "lumi", "Luminosity", 854, 1, 1, { "!lumi" } }, // kAzure-6
+    { "correction_factor", "#oplus Correction factor", 868, 1, 3,
+      { "*" } }, // kAzure+8
+    { "signal_extraction", "#oplus Signal extraction", 852, 1, 2,
+      { "!fit", "!bkg_model_uncorr" } }, // kAzure-8
+    { "stat", "#oplus Statistics", 17, 1, 1, { "@stat" } }
+  });
+  return groups;
+}
+
+namespace {
+
+// ROOT color number, or name with offset, e.g. kAzure-6
+bool parse_color(string_view w, int& color) {
+  static const std::pair<const char*,int> names[] {
+    {"kWhite",0}, {"kBlack",1}, {"kGray",920}, {"kRed",632},
+    {"kGreen",416}, {"kBlue",600}, {"kYellow",400}, {"kMagenta",616},
+    {"kCyan",432}, {"kOrange",800}, {"kSpring",820}, {"kTeal",840},
+    {"kAzure",860}, {"kViolet",880}, {"kPink",900}
+  };
+  const std::string s = w.to_string();
+  const size_t o = s.find_first_of("+-",1);
+  const std::string name = s.substr(0,o);
+  int base = -1;
+  if (!name.empty() && std::isdigit(name[0])) {
+    char* end;
+    base = std::strtol(name.c_str(),&end,10);
+    if (*end) return false;
+  } else {
+    for (const auto& n : names)
+      if (name==n.first) { base = n.second; break; }
+    if (base < 0) return false;
+  }
+  int offset = 0;
+  if (o != std::string::npos) {
+    char* end;
+    offset = std::strtol(s.c_str()+o,&end,10);
+    if (*end || end==s.c_str()+o+1) return false;
+  }
+  color = base + offset;
+  return color >= 0;
+}
+
+}
+
+groups_t read_groups(const char* file_name) {
+  std::vector<group_t> groups;
+  const mapped_file f(file_name);
+  string_view line;
+  unsigned n = 0;
+  for (line_reader next(f.begin(),f.end()); next(line); ) {
+    ++n;
+    skip_space(line);
+    if (line.empty() || line[0]=='#') continue;
+    auto error = [&](const char* what, string_view w = { }){
+      return std::runtime_error(cat(
+        what,w.empty() ? "" : " ",w," in ",file_name," line ",n));
+    };
+
+    group_t g;
+    g.name = next_word(line).to_string();
+    for (int* x : { &g.fill, &g.line }) {
+      const auto w = next_word(line);
+      if (!parse_color(w,*x)) throw error("bad color",w);
+    }
+    { const auto w = next_word(line);
+      char* end;
+      const std::string s = w.to_string();
+      g.style = std::strtol(s.c_str(),&end,10);
+      if (s.empty() || *end) throw error("bad line style",w);
+    }
+    skip_space(line);
+    if (line.empty() || line[0]!='"') throw error("expected quoted label");
+    const auto q = line.find('"',1);
+    if (q==string_view::npos) throw error("unterminated label");
+    g.label = line.substr(1,q-1).to_string();
+    line.remove_prefix(q+1);
+    for (string_view w; !(w = next_word(line)).empty(); ) {
+      if (w[0]=='!' && (w.size()==1 ||
+          w.find_first_of("*?[")!=string_view::npos || w=="!@stat"))
+        throw error("bad required source",w);
+      g.patterns.push_back(w.to_string());
+    }
+    if (g.patterns.empty()) throw error("no sources for group",g.name);
+    groups.push_back(std::move(g));
+  }
+  if (groups.empty()) throw std::runtime_error(cat(
+    "no groups in ",file_name));
+  return groups_t(std::move(groups));
+}
+
+void read_xsec(data_t& data, const char* file_name) {
+  std::unordered_map<std::string,std::vector<double>> xsecs;
+  { const mapped_file f(file_name);
+    string_view line;
+    for (line_reader next(f.begin(),f.end()); next(line); ) {
+      const auto var = next_word(line);
+      auto& xs = xsecs[var.to_string()];
+      for (double x; next_double(line,x); ) xs.push_back(x);
+    }
+  }
+
+  for (auto& v : data.vars) {
+    const auto it = xsecs.find(v.first);
+    if (it==xsecs.end()) throw std::runtime_error(cat(
+      "No sig_fid_SM value for variable ",v.first));
+    const auto& xs1 = it->second;
+    auto& xs0 = v.second.bins;
+    const auto n = xs0.size();
+    if (xs1.size() != n) throw std::runtime_error(cat(
+      "Unequal binning in sig_fid_SM for ",v.first));
+    for (unsigned i=0; i<n; ++i)
+      xs0[i].xsec = xs1[i];
+  }
+}
+
+}